@@ -0,0 +1,124 @@
+#include "access_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+
+#define ACCESS_STREAM_BUFFER_RECORDS (1 << 16)
+
+bool access_stream_enabled = false;
+bool access_stream_sampled = false;
+FILE* access_stream_file = NULL;
+const char* access_stream_path = NULL;
+uint64_t access_stream_sample_every = 1;
+uint64_t access_stream_rng = 0x9e3779b97f4a7c15llu;
+uint64_t access_stream_records = 0;
+
+access_record_t* access_stream_buffer = NULL;
+uint64_t access_stream_buffered = 0;
+access_record_t access_stream_current;
+
+void access_stream_enable(const char* path, uint64_t sample_every) {
+  access_stream_file = fopen(path, "wb");
+  if (!access_stream_file) {
+    panic("Failed to open access stream file %s", path);
+  }
+  access_stream_buffer =
+      malloc(ACCESS_STREAM_BUFFER_RECORDS * sizeof(access_record_t));
+  if (!access_stream_buffer) {
+    panic("Out of memory allocating the access stream buffer");
+  }
+
+  access_stream_enabled = true;
+  access_stream_path = path;
+  access_stream_sample_every = sample_every ? sample_every : 1;
+  access_stream_records = 0;
+  access_stream_buffered = 0;
+
+  struct __attribute__((packed)) {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t page_size_bits;
+    uint64_t sample_every;
+  } header = {{'T', 'L', 'B', 'S', 'A', 'C', 'C', '1'},
+              sizeof(access_record_t),
+              PAGE_SIZE_BITS,
+              access_stream_sample_every};
+  fwrite(&header, sizeof(header), 1, access_stream_file);
+}
+
+bool access_stream_is_enabled() { return access_stream_enabled; }
+
+// Sampling uses its own xorshift generator (rather than a fixed stride, which
+// could alias with loops in the trace) so runs stay reproducible.
+static bool access_stream_sample() {
+  if (access_stream_sample_every == 1) return true;
+  access_stream_rng ^= access_stream_rng << 13;
+  access_stream_rng ^= access_stream_rng >> 7;
+  access_stream_rng ^= access_stream_rng << 17;
+  return access_stream_rng % access_stream_sample_every == 0;
+}
+
+void access_stream_begin() {
+  if (!access_stream_enabled) return;
+  access_stream_sampled = access_stream_sample();
+  memset(&access_stream_current, 0, sizeof(access_stream_current));
+}
+
+void access_stream_set_level(access_hit_level_t level) {
+  if (access_stream_sampled) access_stream_current.level = level;
+}
+
+void access_stream_set_eviction(va_t victim_virtual_page_number) {
+  if (!access_stream_sampled) return;
+  access_stream_current.flags |= ACCESS_RECORD_EVICTION;
+  access_stream_current.victim_virtual_page_number = victim_virtual_page_number;
+}
+
+void access_stream_set_major_fault() {
+  if (access_stream_sampled) access_stream_current.flags |= ACCESS_RECORD_MAJOR;
+}
+
+static void access_stream_flush() {
+  if (access_stream_buffered == 0) return;
+  if (fwrite(access_stream_buffer, sizeof(access_record_t),
+             access_stream_buffered,
+             access_stream_file) != access_stream_buffered) {
+    panic("Failed to write access stream file %s", access_stream_path);
+  }
+  access_stream_buffered = 0;
+}
+
+void access_stream_end(va_t virtual_address, pa_dram_t physical_address,
+                       op_t op, time_ns_t latency) {
+  if (!access_stream_sampled) return;
+  access_stream_sampled = false;
+
+  access_record_t* record = &access_stream_buffer[access_stream_buffered++];
+  *record = access_stream_current;
+  record->virtual_address = virtual_address;
+  record->virtual_page_number = virtual_address >> PAGE_SIZE_BITS;
+  record->physical_address = physical_address;
+  record->latency_ns = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+  record->op = (uint8_t)op;
+  access_stream_records++;
+
+  if (access_stream_buffered == ACCESS_STREAM_BUFFER_RECORDS) {
+    access_stream_flush();
+  }
+}
+
+void access_stream_close() {
+  if (!access_stream_enabled) return;
+  access_stream_flush();
+  fclose(access_stream_file);
+  free(access_stream_buffer);
+  access_stream_file = NULL;
+  access_stream_buffer = NULL;
+  access_stream_enabled = false;
+  log_dbg("Access stream: %" PRIu64 " records written to %s",
+          access_stream_records, access_stream_path);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Per-access result stream for offline analysis.
+// Writes one fixed-size little-endian record per (sampled) access to a binary
+// file, through a large in-memory buffer. The file starts with a header:
+//
+//   char     magic[8];          "TLBSACC1"
+//   uint32_t record_size;       sizeof(access_record_t)
+//   uint32_t page_size_bits;
+//   uint64_t sample_every;      1 = every access was recorded
+//
+// followed by access_record_t records in trace order.
+
+typedef enum {
+  ACCESS_HIT_TLB_L1 = 0,
+  ACCESS_HIT_TLB_L2 = 1,
+  ACCESS_HIT_PAGE_TABLE = 2,
+  ACCESS_PAGE_FAULT = 3,
+  ACCESS_HIT_SEGMENT = 4,  // Translated by a direct segment, no paging.
+} access_hit_level_t;
+
+#define ACCESS_RECORD_EVICTION 0x1  // The access evicted a page from DRAM.
+#define ACCESS_RECORD_MAJOR 0x2     // The fault had to read from disk.
+
+typedef struct __attribute__((packed)) {
+  uint64_t virtual_address;
+  uint64_t virtual_page_number;
+  uint64_t physical_address;
+  uint64_t victim_virtual_page_number;  // Only meaningful with EVICTION.
+  uint32_t latency_ns;
+  uint8_t op;     // op_t
+  uint8_t level;  // access_hit_level_t
+  uint8_t flags;  // ACCESS_RECORD_*
+  uint8_t reserved;
+} access_record_t;
+
+void access_stream_enable(const char* path, uint64_t sample_every);
+bool access_stream_is_enabled();
+
+void access_stream_begin();
+void access_stream_set_level(access_hit_level_t level);
+void access_stream_set_eviction(va_t victim_virtual_page_number);
+void access_stream_set_major_fault();
+void access_stream_end(va_t virtual_address, pa_dram_t physical_address,
+                       op_t op, time_ns_t latency);
+
+void access_stream_close();
@@ -0,0 +1,293 @@
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "log.h"
+#include "stats.h"
+
+typedef struct {
+  bool valid;
+  bool dirty;
+  bool page_table;
+  uint64_t line_number;
+  uint64_t stamp;  // Last use (LRU).
+} cache_line_t;
+
+typedef struct {
+  cache_config_t config;
+  uint64_t sets;
+  uint32_t line_bits;
+  cache_line_t* lines;  // sets * ways, set by set.
+  uint64_t* plru_bits;  // One tree per set, node n at bit n (root is 1).
+  uint64_t hits[CACHE_CLASSES];
+  uint64_t misses[CACHE_CLASSES];
+  uint64_t page_table_lines_evicted_by_data;
+} cache_level_t;
+
+bool cache_enabled = false;
+cache_policy_t cache_policy = CACHE_LRU;
+uint64_t cache_tick = 0;
+
+cache_level_t cache_levels[CACHE_MAX_LEVELS];
+uint32_t cache_level_count = 0;
+
+// Dirty data lines written back from the last level.
+uint64_t cache_write_backs = 0;
+
+static const char* cache_policy_name(cache_policy_t policy) {
+  switch (policy) {
+    case CACHE_LRU:
+      return "lru";
+    case CACHE_PLRU:
+      return "plru";
+  }
+  return "?";
+}
+
+static bool is_power_of_two(uint64_t value) {
+  return value && !(value & (value - 1));
+}
+
+static void cache_register_level_stats(uint32_t index) {
+  static char names[CACHE_MAX_LEVELS][5][48];
+  cache_level_t* level = &cache_levels[index];
+  const char* suffixes[5] = {"page_table_hits", "page_table_misses",
+                             "data_hits", "data_misses",
+                             "page_table_lines_evicted_by_data"};
+  const uint64_t* counters[5] = {
+      &level->hits[CACHE_PAGE_TABLE], &level->misses[CACHE_PAGE_TABLE],
+      &level->hits[CACHE_DATA], &level->misses[CACHE_DATA],
+      &level->page_table_lines_evicted_by_data};
+  for (int i = 0; i < 5; i++) {
+    snprintf(names[index][i], sizeof(names[index][i]), "cache.l%" PRIu32 ".%s",
+             index + 1, suffixes[i]);
+    stats_register_counter(names[index][i], counters[i]);
+  }
+}
+
+void cache_enable(const cache_config_t* levels, uint32_t count,
+                  cache_policy_t policy) {
+  if (count == 0 || count > CACHE_MAX_LEVELS) {
+    panic("--cache: between 1 and %d levels", CACHE_MAX_LEVELS);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    const cache_config_t* config = &levels[i];
+    if (!is_power_of_two(config->line_bytes) ||
+        config->line_bytes < PTE_SIZE_BYTES ||
+        config->line_bytes > PAGE_SIZE_BYTES) {
+      panic("--cache: level %" PRIu32 " line size must be a power of two "
+            "between %d and %" PRIu64 " bytes",
+            i + 1, PTE_SIZE_BYTES, PAGE_SIZE_BYTES);
+    }
+    if (config->ways == 0 || config->ways > 64 ||
+        config->size_bytes % (config->ways * config->line_bytes) != 0 ||
+        config->size_bytes == 0) {
+      panic("--cache: level %" PRIu32 " size must be a non-zero multiple of "
+            "ways (at most 64) times the line size",
+            i + 1);
+    }
+    if (policy == CACHE_PLRU && !is_power_of_two(config->ways)) {
+      panic("--cache-policy=plru: level %" PRIu32
+            " needs a power of two ways",
+            i + 1);
+    }
+  }
+
+  cache_enabled = true;
+  cache_policy = policy;
+  cache_level_count = count;
+  for (uint32_t i = 0; i < count; i++) {
+    cache_level_t* level = &cache_levels[i];
+    level->config = levels[i];
+    level->sets =
+        levels[i].size_bytes / (levels[i].ways * levels[i].line_bytes);
+    level->line_bits = 0;
+    while ((1llu << level->line_bits) < levels[i].line_bytes) {
+      level->line_bits++;
+    }
+    level->lines =
+        calloc(level->sets * levels[i].ways, sizeof(cache_line_t));
+    level->plru_bits = calloc(level->sets, sizeof(uint64_t));
+    if (!level->lines || !level->plru_bits) {
+      panic("Out of memory allocating the caches");
+    }
+    cache_register_level_stats(i);
+  }
+  stats_register_config("cache.levels", count);
+  stats_register_config_string("cache.policy", cache_policy_name(policy));
+  stats_register_counter("cache.write_backs", &cache_write_backs);
+}
+
+bool cache_is_enabled() { return cache_enabled; }
+
+// Points every node of the set's tree on the way to the line away from it.
+static void plru_touch(cache_level_t* level, uint64_t set, uint64_t way) {
+  uint64_t* bits = &level->plru_bits[set];
+  uint64_t node = 1;
+  for (uint64_t half = level->config.ways >> 1; half; half >>= 1) {
+    uint64_t right = (way & half) != 0;
+    if (right) {
+      *bits &= ~(1llu << node);
+    } else {
+      *bits |= 1llu << node;
+    }
+    node = 2 * node + right;
+  }
+}
+
+static uint64_t plru_victim(const cache_level_t* level, uint64_t set) {
+  uint64_t bits = level->plru_bits[set];
+  uint64_t node = 1;
+  uint64_t way = 0;
+  for (uint64_t half = level->config.ways >> 1; half; half >>= 1) {
+    uint64_t right = (bits >> node) & 1;
+    way = (way << 1) | right;
+    node = 2 * node + right;
+  }
+  return way;
+}
+
+static void touch(cache_level_t* level, uint64_t set, uint64_t way) {
+  if (cache_policy == CACHE_PLRU) {
+    plru_touch(level, set, way);
+  } else {
+    level->lines[set * level->config.ways + way].stamp = ++cache_tick;
+  }
+}
+
+static cache_line_t* find(cache_level_t* level, uint64_t address) {
+  uint64_t line_number = address >> level->line_bits;
+  uint64_t set = line_number % level->sets;
+  cache_line_t* lines = &level->lines[set * level->config.ways];
+  for (uint64_t way = 0; way < level->config.ways; way++) {
+    if (lines[way].valid && lines[way].line_number == line_number) {
+      touch(level, set, way);
+      return &lines[way];
+    }
+  }
+  return NULL;
+}
+
+static void install(uint32_t index, uint64_t address, bool dirty,
+                    bool page_table);
+
+// Dirty lines move down one level, and leave the hierarchy from the last.
+static void write_back(uint32_t index, const cache_line_t* victim) {
+  if (index + 1 == cache_level_count) {
+    cache_write_backs++;
+    return;
+  }
+  uint64_t address = victim->line_number << cache_levels[index].line_bits;
+  cache_line_t* below = find(&cache_levels[index + 1], address);
+  if (below) {
+    below->dirty = true;
+  } else {
+    install(index + 1, address, true, victim->page_table);
+  }
+}
+
+static void install(uint32_t index, uint64_t address, bool dirty,
+                    bool page_table) {
+  cache_level_t* level = &cache_levels[index];
+  uint64_t line_number = address >> level->line_bits;
+  uint64_t set = line_number % level->sets;
+  cache_line_t* lines = &level->lines[set * level->config.ways];
+
+  uint64_t way = level->config.ways;
+  for (uint64_t i = 0; i < level->config.ways && way == level->config.ways;
+       i++) {
+    if (!lines[i].valid) {
+      way = i;
+    }
+  }
+  if (way == level->config.ways) {
+    if (cache_policy == CACHE_PLRU) {
+      way = plru_victim(level, set);
+    } else {
+      way = 0;
+      for (uint64_t i = 1; i < level->config.ways; i++) {
+        if (lines[i].stamp < lines[way].stamp) {
+          way = i;
+        }
+      }
+    }
+    cache_line_t victim = lines[way];
+    if (victim.page_table && !page_table) {
+      level->page_table_lines_evicted_by_data++;
+    }
+    if (victim.dirty) {
+      write_back(index, &victim);
+    }
+  }
+  lines[way] = (cache_line_t){true, dirty, page_table, line_number, 0};
+  touch(level, set, way);
+}
+
+bool cache_access(uint64_t address, op_t op, cache_class_t class) {
+  if (!cache_enabled) return false;
+
+  bool page_table = class == CACHE_PAGE_TABLE;
+  bool timed = page_table && op == OP_READ;
+  uint32_t hit_level = cache_level_count;
+  for (uint32_t i = 0; i < cache_level_count; i++) {
+    cache_level_t* level = &cache_levels[i];
+    if (timed) {
+      increment_time(level->config.latency);
+    }
+    cache_line_t* line = find(level, address);
+    if (line) {
+      level->hits[class]++;
+      if (i == 0 && op == OP_WRITE && !page_table) {
+        line->dirty = true;
+      }
+      hit_level = i;
+      break;
+    }
+    level->misses[class]++;
+  }
+
+  // Page table writes are written through, so only data lines get dirty,
+  // and only in the first level.
+  for (uint32_t i = 0; i < hit_level; i++) {
+    install(i, address, i == 0 && op == OP_WRITE && !page_table, page_table);
+  }
+  return hit_level < cache_level_count;
+}
+
+static double hit_rate(uint64_t hits, uint64_t misses) {
+  return hits + misses ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+void cache_report() {
+  if (!cache_enabled) return;
+
+  log("=========== Cache Statistics ===========");
+  log("  %" PRIu32 " levels, %s replacement", cache_level_count,
+      cache_policy_name(cache_policy));
+  log("  %-5s %9s %5s %5s %4s %12s %9s %12s %9s %12s", "Level", "Size", "Ways",
+      "Line", "ns", "PT accesses", "PT hits", "Data access", "Data hits",
+      "PT evicted");
+  for (uint32_t i = 0; i < cache_level_count; i++) {
+    const cache_level_t* level = &cache_levels[i];
+    log("  L%-4" PRIu32 " %8" PRIu64 "K %5" PRIu64 " %5" PRIu64 " %4" PRIu64
+        " %12" PRIu64 " %8.2f%% %12" PRIu64 " %8.2f%% %12" PRIu64,
+        i + 1, level->config.size_bytes >> 10, level->config.ways,
+        level->config.line_bytes, level->config.latency,
+        level->hits[CACHE_PAGE_TABLE] + level->misses[CACHE_PAGE_TABLE],
+        hit_rate(level->hits[CACHE_PAGE_TABLE],
+                 level->misses[CACHE_PAGE_TABLE]),
+        level->hits[CACHE_DATA] + level->misses[CACHE_DATA],
+        hit_rate(level->hits[CACHE_DATA], level->misses[CACHE_DATA]),
+        level->page_table_lines_evicted_by_data);
+  }
+  const cache_level_t* last = &cache_levels[cache_level_count - 1];
+  log("  Page table accesses missing every level: %" PRIu64,
+      last->misses[CACHE_PAGE_TABLE]);
+  log("  Data accesses missing every level: %" PRIu64,
+      last->misses[CACHE_DATA]);
+  log("  Dirty data lines written back: %" PRIu64, cache_write_backs);
+  log("  (PT evicted: page table lines evicted to make room for data)");
+  log("========================================");
+}
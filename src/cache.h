@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Set-associative CPU cache hierarchy, in front of DRAM.
+// Page-walk reads look the hierarchy up level by level, paying each probed
+// level's latency, and only go to DRAM when every level misses; a hit at
+// some level fills the ones above it (the hierarchy is non-inclusive). Data
+// accesses go through the same caches so they compete with the page table
+// for space, but stay untimed, as they are without caches. Page table writes
+// are written through to DRAM (their cost is unchanged) and allocate; data
+// writes are write-back, dirty lines moving down on eviction and counted
+// when they leave the last level. Page table lines live in an address space
+// of their own (see page_table.c), so they never alias data lines.
+
+typedef enum {
+  CACHE_LRU,
+  CACHE_PLRU,  // Tree pseudo-LRU; needs a power of two ways.
+} cache_policy_t;
+
+typedef enum {
+  CACHE_DATA,
+  CACHE_PAGE_TABLE,
+  CACHE_CLASSES,
+} cache_class_t;
+
+typedef struct {
+  uint64_t size_bytes;
+  uint64_t ways;
+  uint64_t line_bytes;
+  time_ns_t latency;
+} cache_config_t;
+
+// Levels are given from the one closest to the core.
+void cache_enable(const cache_config_t* levels, uint32_t count,
+                  cache_policy_t policy);
+bool cache_is_enabled();
+
+// Whether the access was served by a cache; a miss is the caller's to send
+// to DRAM. Only page table reads are charged.
+bool cache_access(uint64_t address, op_t op, cache_class_t class);
+
+// Per-level hit rates for page table and data accesses.
+void cache_report();
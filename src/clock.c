@@ -1,7 +1,13 @@
 #include "clock.h"
 
+#include "stats.h"
+
 time_ns_t current_time = 0;
 
-void reset_time() { current_time = 0; }
+void reset_time() {
+  current_time = 0;
+  stats_register_counter("clock.elapsed_ns", &current_time);
+}
+
 time_ns_t get_time() { return current_time; }
 void increment_time(time_ns_t dt) { current_time += dt; }
\ No newline at end of file
@@ -44,6 +44,121 @@
 #define DRAM_LATENCY_NS 100
 #define DISK_LATENCY_NS 1000000
 
+// Number of address spaces (processes) a trace can switch between or fork.
+#define MAX_ADDRESS_SPACES 64
+
+// Per-page statistics (--page-stats). The report lists the N hottest and most
+// thrashed pages, and folds the virtual address space into a fixed number of
+// bins for the heatmap, each drawn as a bar of at most the given width.
+#define PAGE_STATS_DEFAULT_TOP_N 10
+#define PAGE_STATS_HEATMAP_BINS 64
+#define PAGE_STATS_HEATMAP_WIDTH 40
+
+// Working-set-size sketch (--wss). 2^WSS_SKETCH_REGISTER_BITS HyperLogLog
+// registers give a standard error of about 1.04 / sqrt(registers), i.e. ~3%
+// for 10 bits. Ranks above WSS_SKETCH_MAX_RANK are clamped, which only
+// matters for cardinalities far beyond TOTAL_PAGES.
+#define WSS_SKETCH_REGISTER_BITS 10
+#define WSS_SKETCH_MAX_RANK 32
+
+// Default gap for --regions-auto: touched pages closer than this end up in
+// the same inferred region.
+#define REGION_AUTO_DEFAULT_GAP_BYTES (16llu << 20)
+
+// NUMA (--numa). DRAM frames are split evenly between up to NUMA_MAX_NODES
+// nodes; an access to another node's memory costs NUMA_REMOTE_LATENCY_NS
+// instead of DRAM_LATENCY_NS. Automatic balancing migrates a page after this
+// many consecutive accesses from the same remote node.
+#define NUMA_MAX_NODES 8
+#define NUMA_REMOTE_LATENCY_NS 160
+#define NUMA_BALANCE_DEFAULT_THRESHOLD 8
+
+// Slow memory tier (--tier), CXL/PMem-like. Its frames are numbered right
+// after DRAM's, so its capacity is bounded by TIER_MAX_PAGES. A page is
+// promoted back to DRAM once it has been accessed TIER_DEFAULT_HOT_THRESHOLD
+// times in the tier (hotness halves each time the spill clock passes it).
+#define TIER_MAX_PAGES (1llu << 20)
+#define TIER_DEFAULT_LATENCY_NS 300
+#define TIER_DEFAULT_HOT_THRESHOLD 4
+
+// Compressed swap pool (--zswap). Pages are compressed to
+// ZSWAP_DEFAULT_RATIO_PERCENT of their size unless the trace says otherwise;
+// pages that don't compress below ZSWAP_MAX_RATIO_PERCENT go straight to
+// disk. Compressing a page costs ZSWAP_COMPRESS_LATENCY_NS, decompressing it
+// (on a swap-in or a write-back to disk) ZSWAP_DEFAULT_DECOMPRESS_LATENCY_NS.
+#define ZSWAP_DEFAULT_RATIO_PERCENT 33
+#define ZSWAP_MAX_RATIO_PERCENT 90
+#define ZSWAP_COMPRESS_LATENCY_NS 4000
+#define ZSWAP_DEFAULT_DECOMPRESS_LATENCY_NS 2000
+
+// Transparent huge pages (--thp). A huge page maps 2^HUGE_PAGE_ORDER base
+// pages (2 MiB of 4 KiB pages) with a single PTE and a single TLB entry.
+// khugepaged wakes up every THP_DEFAULT_SCAN_PERIOD accesses and looks at
+// THP_DEFAULT_SCAN_REGIONS aligned regions (4096 pages, like Linux's
+// pages_to_scan).
+#define HUGE_PAGE_ORDER 9
+#define THP_DEFAULT_SCAN_PERIOD 10000
+#define THP_DEFAULT_SCAN_REGIONS 8
+
+// Coalesced TLB entries (--colt). By default an entry may cover the pages of
+// one 64-byte line of 8-byte PTEs, i.e. aligned groups of 8 pages.
+#define TLB_COALESCE_DEFAULT_PAGES 8
+
+// Radix page table (--pt-levels). Every level below the root indexes
+// PT_LEVEL_BITS bits of the page number (512 entries of 8 bytes per table, as
+// on x86-64); the root takes whatever is left. One level is the flat table.
+// Paging-structure caches (--pwc) hold upper-level entries so walks can skip
+// levels; by default PWC_DEFAULT_ENTRIES per level, looked up in
+// PWC_DEFAULT_LATENCY_NS.
+#define PT_LEVEL_BITS 9
+#define PT_MAX_LEVELS 6
+#define PWC_DEFAULT_ENTRIES 32
+#define PWC_DEFAULT_LATENCY_NS 1
+
+// Direct segments (--segments, "D" records): size of the segment table, per
+// simulated machine, like a handful of base/limit/offset registers.
+#define SEGMENT_MAX_ENTRIES 8
+
+// CPU caches (--cache), shared by page-walk and data accesses. Without an
+// explicit geometry, a three-level hierarchy with these sizes, ways, line
+// sizes and hit latencies; at most CACHE_MAX_LEVELS levels. Page table
+// entries are PTE_SIZE_BYTES wide, so a line holds several neighbours.
+#define CACHE_MAX_LEVELS 4
+#define CACHE_L1_SIZE_BYTES (32llu << 10)
+#define CACHE_L1_WAYS 8
+#define CACHE_L1_LATENCY_NS 1
+#define CACHE_L2_SIZE_BYTES (1llu << 20)
+#define CACHE_L2_WAYS 16
+#define CACHE_L2_LATENCY_NS 4
+#define CACHE_L3_SIZE_BYTES (8llu << 20)
+#define CACHE_L3_WAYS 16
+#define CACHE_L3_LATENCY_NS 12
+#define CACHE_LINE_SIZE_BYTES 64
+#define PTE_SIZE_BYTES 8
+
+// Nested paging (--nested). The host page table translating guest-physical
+// addresses has NESTED_DEFAULT_HOST_LEVELS levels, like a 4-level EPT; a
+// nested TLB of NESTED_TLB_DEFAULT_ENTRIES entries caches its translations.
+// Under shadow paging, every guest page table write and address space switch
+// exits to the hypervisor, for VM_EXIT_LATENCY_NS.
+#define NESTED_MAX_HOST_LEVELS 4
+#define NESTED_DEFAULT_HOST_LEVELS 4
+#define NESTED_TLB_DEFAULT_ENTRIES 16
+#define VM_EXIT_LATENCY_NS 1000
+
+// Write-combining buffer for TLB write-backs (--wcb): pending PTE updates,
+// one entry per page table cache line (CACHE_LINE_SIZE_BYTES).
+#define WCB_DEFAULT_ENTRIES 8
+
+// Default interval, in host seconds, between --progress reports.
+#define PROGRESS_DEFAULT_INTERVAL_S 10
+
+// Self-profiling of the simulator's hot paths (see profile.h). Off by default;
+// build with -DSIM_PROFILE=1 to enable.
+#ifndef SIM_PROFILE
+#define SIM_PROFILE 0
+#endif
+
 // ========================================================================
 // Constants defined from the constants above.
 // ========================================================================
@@ -58,6 +173,8 @@
 #define DISK_PAGE_CAPACITY \
   (uint64_t)(1llu << (DISK_ADDRESS_BITS - PAGE_SIZE_BITS))
 #define TOTAL_PAGES (uint64_t)(1llu << (VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS))
+#define HUGE_PAGE_PAGES (uint64_t)(1llu << HUGE_PAGE_ORDER)
+#define PT_INDEX_BITS (VIRTUAL_ADDRESS_BITS - PAGE_SIZE_BITS)
 
 #define VIRTUAL_ADDRESS_MASK (VIRTUAL_SIZE_BYTES - 1)
 #define DRAM_ADDRESS_MASK (DRAM_SIZE_BYTES - 1)
@@ -1,12 +1,252 @@
+#include <getopt.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "access_stream.h"
+#include "cache.h"
 #include "clock.h"
 #include "constants.h"
 #include "log.h"
+#include "nested.h"
+#include "numa.h"
 #include "memory.h"
+#include "page_stats.h"
 #include "page_table.h"
+#include "profile.h"
+#include "progress.h"
+#include "pwc.h"
+#include "region.h"
+#include "reuse.h"
+#include "segment.h"
+#include "stats.h"
+#include "thp.h"
+#include "timeline.h"
+#include "tier.h"
 #include "tlb.h"
+#include "wcb.h"
+#include "wss.h"
+#include "zswap.h"
+
+static void print_usage(const char* program) {
+  log_dbg("Usage: %s [options] <instructions_file>", program);
+  log_dbg("Options:");
+  log_dbg("  --detailed         Also report every memory-system event class");
+  log_dbg("  --page-stats[=N]   Report the N hottest/most thrashed pages and an");
+  log_dbg("                     address space heatmap (default N=%d)",
+          PAGE_STATS_DEFAULT_TOP_N);
+  log_dbg("  --reuse=FILE       Write reuse-distance and inter-reference time");
+  log_dbg("                     histograms to FILE (CSV)");
+  log_dbg("  --wss=N[ns]        Track the working set size over a sliding window");
+  log_dbg("                     of the last N accesses (or N simulated ns)");
+  log_dbg("  --wss-step=N       Sample the working set every N accesses/ns");
+  log_dbg("                     (default: once per window)");
+  log_dbg("  --wss-out=FILE     Write the working set time series to FILE (CSV)");
+  log_dbg("  --stats-json=FILE  Write all counters and the configuration as JSON");
+  log_dbg("  --stats-csv=FILE   Write all counters and the configuration as CSV");
+  log_dbg("  --progress[=SECS]  Print progress to stderr every SECS seconds");
+  log_dbg("                     (default %d)", PROGRESS_DEFAULT_INTERVAL_S);
+  log_dbg("  --snapshot=FILE    Where SIGUSR1 writes statistics snapshots");
+  log_dbg("                     (default: stderr)");
+  log_dbg("  --timeline=FILE    Write a Chrome/Perfetto trace-event timeline");
+  log_dbg("  --timeline-sample=N  Record one access in every N (default 1)");
+  log_dbg("  --timeline-range=START:END  Only record events overlapping this");
+  log_dbg("                     simulated time range, in ns");
+  log_dbg("  --regions=FILE     Attribute statistics to the VA regions listed in");
+  log_dbg("                     FILE (\"<start> <end> <name>\" lines, hex)");
+  log_dbg("  --regions-auto[=GAP]  Infer regions by clustering touched pages");
+  log_dbg("                     less than GAP bytes apart (default %llu)",
+          REGION_AUTO_DEFAULT_GAP_BYTES);
+  log_dbg("  --access-stream=FILE  Write a binary record per access (see");
+  log_dbg("                     access_stream.h for the format)");
+  log_dbg("  --access-stream-sample=N  Record about one access in N");
+  log_dbg("  --exact-evictions  Give an evicted page's own frame to the faulting");
+  log_dbg("                     page (default: the victim's VPN, as in the");
+  log_dbg("                     reference simulator); implied by the options");
+  log_dbg("                     that share, move or free frames, and by F, M,");
+  log_dbg("                     K and D records");
+  log_dbg("  --zero-page        Map first-touch reads to a shared zero page");
+  log_dbg("  --numa=N[:C]       Split DRAM into N NUMA nodes of C cores each");
+  log_dbg("                     (default C=1)");
+  log_dbg("  --numa-policy=P    Page placement: first-touch (default),");
+  log_dbg("                     interleave or preferred[:NODE]");
+  log_dbg("  --numa-remote-latency=NS  Remote DRAM access latency (default %d)",
+          NUMA_REMOTE_LATENCY_NS);
+  log_dbg("  --numa-balance[=N] Migrate pages after N consecutive accesses");
+  log_dbg("                     from the same remote node (default %d)",
+          NUMA_BALANCE_DEFAULT_THRESHOLD);
+  log_dbg("  --tier=PAGES[:NS]  Add a slow memory tier of PAGES pages (default");
+  log_dbg("                     latency %d ns); evictions demote into it",
+          TIER_DEFAULT_LATENCY_NS);
+  log_dbg("  --tier-hot=N       Promote a tier page after N accesses (default %d)",
+          TIER_DEFAULT_HOT_THRESHOLD);
+  log_dbg("  --tier-promote-rate=N  Promote at most N pages per simulated ms");
+  log_dbg("  --zswap=PAGES[:NS] Compress swapped-out pages into a DRAM pool of");
+  log_dbg("                     up to PAGES frames (default decompression %d ns)",
+          ZSWAP_DEFAULT_DECOMPRESS_LATENCY_NS);
+  log_dbg("  --zswap-ratio=PCT  Compressed size in %% of a page (default %d)",
+          ZSWAP_DEFAULT_RATIO_PERCENT);
+  log_dbg("  --thp[=N[:R]]      Transparent huge pages: khugepaged collapses up");
+  log_dbg("                     to R regions every N accesses (default %d:%d)",
+          THP_DEFAULT_SCAN_PERIOD, THP_DEFAULT_SCAN_REGIONS);
+  log_dbg("  --pt-levels=N      Walk an N-level radix page table (default 1)");
+  log_dbg("  --pwc=N[,N...][:NS]  Page-walk caches of N entries for levels 2,");
+  log_dbg("                     3... (the last size repeats; default %d, %d ns)",
+          PWC_DEFAULT_ENTRIES, PWC_DEFAULT_LATENCY_NS);
+  log_dbg("  --pwc-policy=P     Page-walk cache replacement: lru (default), fifo");
+  log_dbg("                     or random");
+  log_dbg("  --hw-dirty-bits    Set PTE dirty bits on the first write through a");
+  log_dbg("                     clean TLB entry instead of writing back dirty");
+  log_dbg("                     entries when they leave the TLB");
+  log_dbg("  --wcb[=N]          Combine TLB write-backs by page table line in");
+  log_dbg("                     a buffer of N lines (default %d)",
+          WCB_DEFAULT_ENTRIES);
+  log_dbg("  --nested=MODE      Run as a virtualized guest: ept (2D walks),");
+  log_dbg("                     ept-huge (huge host pages) or shadow");
+  log_dbg("  --host-pt-levels=N Host page table levels for ept (default %d)",
+          NESTED_DEFAULT_HOST_LEVELS);
+  log_dbg("  --ntlb=N           Nested TLB entries for ept, 0 for none");
+  log_dbg("                     (default %d)", NESTED_TLB_DEFAULT_ENTRIES);
+  log_dbg("  --cache[=S:W:L:NS,...]  CPU caches in front of DRAM for page");
+  log_dbg("                     walks and data, SIZE:WAYS:LINE:NS per level");
+  log_dbg("                     (sizes take K/M; default 32K:8:64:1,");
+  log_dbg("                     1M:16:64:4,8M:16:64:12)");
+  log_dbg("  --cache-policy=P   Cache replacement: lru (default) or plru");
+  log_dbg("  --segments=FILE    Direct segments translating whole VA ranges,");
+  log_dbg("                     \"<base> <limit> <physical base>\" lines (hex)");
+  log_dbg("  --colt[=N]         Coalesce TLB entries for contiguous frames in");
+  log_dbg("                     groups of N pages (default %d), and allocate",
+          TLB_COALESCE_DEFAULT_PAGES);
+  log_dbg("                     frames next to neighbouring pages' frames");
+  log_dbg("SIGINT stops the run early but still prints and exports results.");
+}
+
+// Trace records:
+//   R <va>                read
+//   W <va>                write
+//   P <va>                software prefetch (fills the TLB, never faults)
+//   F <va> <len>          munmap/free of a range
+//   M <va> <len> [flags]  mmap of a range; flags: p = populate,
+//                         f = file-backed (default anonymous)
+//   C <asid>              context switch to an address space
+//   K <asid>              fork the current address space into <asid>
+//                         (anonymous pages are shared copy-on-write)
+//   S <core>              run the following accesses on <core> (NUMA)
+//   Z <percent>           compressed size of pages swapped out from now on
+//                         (zswap)
+//   D <va> <len> <pa>     direct segment: [va, va + len) of the current
+//                         address space translates to pa onwards
+// All numbers are hexadecimal.
+static uint32_t parse_map_flags(const char* flags, const char* line) {
+  uint32_t parsed = 0;
+  for (const char* flag = flags; *flag; flag++) {
+    switch (*flag) {
+      case 'p':
+        parsed |= MAP_FLAG_POPULATE;
+        break;
+      case 'f':
+        parsed |= MAP_FLAG_FILE;
+        break;
+      default:
+        panic("Unknown mmap flag '%c': %s", *flag, line);
+    }
+  }
+  return parsed;
+}
+
+// Checked before narrowing, so that out-of-range numbers can't wrap into a
+// valid address space.
+static asid_t parse_asid(uint64_t asid, const char* line) {
+  if (asid >= MAX_ADDRESS_SPACES) {
+    panic("Address space %" PRIx64 " out of range (max %x): %s", asid,
+          MAX_ADDRESS_SPACES - 1, line);
+  }
+  return (asid_t)asid;
+}
+
+// Whether the trace has records that share, move or free frames (F, M, K and
+// D), which need exact evictions from its very first access.
+static bool trace_moves_frames(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    panic("Failed to open instructions file %s", path);
+  }
+  char line[256];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), file)) {
+    found = strchr("FMKD", line[0]) && line[0] != '\0';
+  }
+  fclose(file);
+  return found;
+}
+
+static uint64_t parse_u64_option(const char* name, const char* value) {
+  char* end;
+  uint64_t parsed = strtoull(value, &end, 0);
+  if (*value == '\0' || *end != '\0') {
+    panic("Invalid value for --%s: %s", name, value);
+  }
+  return parsed;
+}
+
+// Like parse_u64_option, with an optional K, M or G suffix.
+static uint64_t parse_size_option(const char* name, const char* value) {
+  char* end;
+  uint64_t parsed = strtoull(value, &end, 0);
+  uint32_t shift = 0;
+  switch (*end) {
+    case 'K':
+    case 'k':
+      shift = 10;
+      end++;
+      break;
+    case 'M':
+    case 'm':
+      shift = 20;
+      end++;
+      break;
+    case 'G':
+    case 'g':
+      shift = 30;
+      end++;
+      break;
+  }
+  if (*value == '\0' || *end != '\0') {
+    panic("Invalid value for --%s: %s", name, value);
+  }
+  return parsed << shift;
+}
+
+// Parses "SIZE:WAYS:LINE:NS" levels separated by commas.
+static uint32_t parse_cache_levels(char* value, cache_config_t* levels) {
+  uint32_t count = 0;
+  for (char* level = strtok(value, ","); level; level = strtok(NULL, ",")) {
+    if (count == CACHE_MAX_LEVELS) {
+      panic("--cache: at most %d levels", CACHE_MAX_LEVELS);
+    }
+    char* fields[4] = {level, NULL, NULL, NULL};
+    for (int i = 1; i < 4 && fields[i - 1]; i++) {
+      fields[i] = strchr(fields[i - 1], ':');
+      if (fields[i]) {
+        *fields[i]++ = '\0';
+      }
+    }
+    if (!fields[3] || strchr(fields[3], ':')) {
+      panic("Invalid cache level for --cache, expected SIZE:WAYS:LINE:NS");
+    }
+    levels[count++] = (cache_config_t){
+        parse_size_option("cache", fields[0]),
+        parse_u64_option("cache", fields[1]),
+        parse_size_option("cache", fields[2]),
+        parse_u64_option("cache", fields[3]),
+    };
+  }
+  if (count == 0) {
+    panic("Invalid value for --cache: %s", value);
+  }
+  return count;
+}
 
 int main(int argc, char* argv[]) {
   log_dbg("=========== System Properties ===========");
@@ -21,31 +261,545 @@ int main(int argc, char* argv[]) {
   log_dbg("Total pages:           %" PRIu64, TOTAL_PAGES);
   log_dbg("=========================================");
 
-  if (argc < 2) {
-    panic("Usage: %s <instructions_file>", argv[0]);
+  enum {
+    OPT_DETAILED = 256,
+    OPT_PAGE_STATS,
+    OPT_REUSE,
+    OPT_WSS,
+    OPT_WSS_STEP,
+    OPT_WSS_OUT,
+    OPT_STATS_JSON,
+    OPT_STATS_CSV,
+    OPT_PROGRESS,
+    OPT_SNAPSHOT,
+    OPT_TIMELINE,
+    OPT_TIMELINE_SAMPLE,
+    OPT_TIMELINE_RANGE,
+    OPT_REGIONS,
+    OPT_REGIONS_AUTO,
+    OPT_ACCESS_STREAM,
+    OPT_ACCESS_STREAM_SAMPLE,
+    OPT_EXACT_EVICTIONS,
+    OPT_ZERO_PAGE,
+    OPT_NUMA,
+    OPT_NUMA_POLICY,
+    OPT_NUMA_REMOTE_LATENCY,
+    OPT_NUMA_BALANCE,
+    OPT_TIER,
+    OPT_TIER_HOT,
+    OPT_TIER_PROMOTE_RATE,
+    OPT_ZSWAP,
+    OPT_ZSWAP_RATIO,
+    OPT_THP,
+    OPT_COLT,
+    OPT_SEGMENTS,
+    OPT_PT_LEVELS,
+    OPT_PWC,
+    OPT_PWC_POLICY,
+    OPT_CACHE,
+    OPT_CACHE_POLICY,
+    OPT_NESTED,
+    OPT_HOST_PT_LEVELS,
+    OPT_NTLB,
+    OPT_HW_DIRTY_BITS,
+    OPT_WCB,
+  };
+  static const struct option long_options[] = {
+      {"detailed", no_argument, NULL, OPT_DETAILED},
+      {"page-stats", optional_argument, NULL, OPT_PAGE_STATS},
+      {"reuse", required_argument, NULL, OPT_REUSE},
+      {"wss", required_argument, NULL, OPT_WSS},
+      {"wss-step", required_argument, NULL, OPT_WSS_STEP},
+      {"wss-out", required_argument, NULL, OPT_WSS_OUT},
+      {"stats-json", required_argument, NULL, OPT_STATS_JSON},
+      {"stats-csv", required_argument, NULL, OPT_STATS_CSV},
+      {"progress", optional_argument, NULL, OPT_PROGRESS},
+      {"snapshot", required_argument, NULL, OPT_SNAPSHOT},
+      {"timeline", required_argument, NULL, OPT_TIMELINE},
+      {"timeline-sample", required_argument, NULL, OPT_TIMELINE_SAMPLE},
+      {"timeline-range", required_argument, NULL, OPT_TIMELINE_RANGE},
+      {"regions", required_argument, NULL, OPT_REGIONS},
+      {"regions-auto", optional_argument, NULL, OPT_REGIONS_AUTO},
+      {"access-stream", required_argument, NULL, OPT_ACCESS_STREAM},
+      {"access-stream-sample", required_argument, NULL,
+       OPT_ACCESS_STREAM_SAMPLE},
+      {"exact-evictions", no_argument, NULL, OPT_EXACT_EVICTIONS},
+      {"zero-page", no_argument, NULL, OPT_ZERO_PAGE},
+      {"numa", required_argument, NULL, OPT_NUMA},
+      {"numa-policy", required_argument, NULL, OPT_NUMA_POLICY},
+      {"numa-remote-latency", required_argument, NULL,
+       OPT_NUMA_REMOTE_LATENCY},
+      {"numa-balance", optional_argument, NULL, OPT_NUMA_BALANCE},
+      {"tier", required_argument, NULL, OPT_TIER},
+      {"tier-hot", required_argument, NULL, OPT_TIER_HOT},
+      {"tier-promote-rate", required_argument, NULL, OPT_TIER_PROMOTE_RATE},
+      {"zswap", required_argument, NULL, OPT_ZSWAP},
+      {"zswap-ratio", required_argument, NULL, OPT_ZSWAP_RATIO},
+      {"thp", optional_argument, NULL, OPT_THP},
+      {"colt", optional_argument, NULL, OPT_COLT},
+      {"segments", required_argument, NULL, OPT_SEGMENTS},
+      {"pt-levels", required_argument, NULL, OPT_PT_LEVELS},
+      {"pwc", optional_argument, NULL, OPT_PWC},
+      {"pwc-policy", required_argument, NULL, OPT_PWC_POLICY},
+      {"cache", optional_argument, NULL, OPT_CACHE},
+      {"cache-policy", required_argument, NULL, OPT_CACHE_POLICY},
+      {"nested", required_argument, NULL, OPT_NESTED},
+      {"host-pt-levels", required_argument, NULL, OPT_HOST_PT_LEVELS},
+      {"ntlb", required_argument, NULL, OPT_NTLB},
+      {"hw-dirty-bits", no_argument, NULL, OPT_HW_DIRTY_BITS},
+      {"wcb", optional_argument, NULL, OPT_WCB},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+
+  bool detailed = false;
+  bool page_stats = false;
+  uint64_t page_stats_top_n = PAGE_STATS_DEFAULT_TOP_N;
+  const char* reuse_path = NULL;
+  uint64_t wss_window = 0;
+  uint64_t wss_step = 0;
+  wss_window_unit_t wss_unit = WSS_WINDOW_ACCESSES;
+  const char* wss_path = NULL;
+  const char* stats_json_path = NULL;
+  const char* stats_csv_path = NULL;
+  uint64_t progress_interval = 0;
+  const char* snapshot_path = NULL;
+  const char* timeline_path = NULL;
+  uint64_t timeline_sample = 1;
+  time_ns_t timeline_start = 0;
+  time_ns_t timeline_end = UINT64_MAX;
+  const char* regions_path = NULL;
+  bool regions_auto = false;
+  uint64_t regions_auto_gap = 0;
+  const char* access_stream_path = NULL;
+  uint64_t access_stream_sample = 1;
+  bool exact_evictions = false;
+  bool zero_page = false;
+  bool numa = false;
+  uint64_t numa_nodes = 0;
+  uint64_t numa_cores_per_node = 1;
+  numa_policy_t numa_policy = NUMA_FIRST_TOUCH;
+  uint64_t numa_preferred_node = 0;
+  uint64_t numa_remote_latency = NUMA_REMOTE_LATENCY_NS;
+  uint64_t numa_balance = 0;
+  bool tier = false;
+  uint64_t tier_pages = 0;
+  uint64_t tier_latency = TIER_DEFAULT_LATENCY_NS;
+  uint64_t tier_hot = TIER_DEFAULT_HOT_THRESHOLD;
+  uint64_t tier_promote_rate = 0;
+  bool zswap = false;
+  uint64_t zswap_pages = 0;
+  uint64_t zswap_latency = ZSWAP_DEFAULT_DECOMPRESS_LATENCY_NS;
+  uint64_t zswap_ratio = ZSWAP_DEFAULT_RATIO_PERCENT;
+  bool thp = false;
+  uint64_t thp_scan_period = THP_DEFAULT_SCAN_PERIOD;
+  uint64_t thp_scan_regions = THP_DEFAULT_SCAN_REGIONS;
+  bool colt = false;
+  uint64_t colt_pages = 0;
+  const char* segments_path = NULL;
+  uint64_t pt_levels = 1;
+  bool pwc = false;
+  uint64_t pwc_entries[PT_MAX_LEVELS] = {PWC_DEFAULT_ENTRIES};
+  uint32_t pwc_sizes = 1;
+  uint64_t pwc_latency = PWC_DEFAULT_LATENCY_NS;
+  pwc_policy_t pwc_policy = PWC_LRU;
+  cache_config_t cache_levels[CACHE_MAX_LEVELS] = {
+      {CACHE_L1_SIZE_BYTES, CACHE_L1_WAYS, CACHE_LINE_SIZE_BYTES,
+       CACHE_L1_LATENCY_NS},
+      {CACHE_L2_SIZE_BYTES, CACHE_L2_WAYS, CACHE_LINE_SIZE_BYTES,
+       CACHE_L2_LATENCY_NS},
+      {CACHE_L3_SIZE_BYTES, CACHE_L3_WAYS, CACHE_LINE_SIZE_BYTES,
+       CACHE_L3_LATENCY_NS},
+  };
+  uint32_t cache_level_count = 0;
+  cache_policy_t cache_policy = CACHE_LRU;
+  bool nested = false;
+  nested_mode_t nested_mode = NESTED_EPT;
+  bool nested_huge_host_pages = false;
+  uint64_t host_pt_levels = NESTED_DEFAULT_HOST_LEVELS;
+  uint64_t nested_tlb_entries = NESTED_TLB_DEFAULT_ENTRIES;
+  bool hw_dirty_bits = false;
+  bool wcb = false;
+  uint64_t wcb_entries = WCB_DEFAULT_ENTRIES;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case OPT_DETAILED:
+        detailed = true;
+        break;
+      case OPT_PAGE_STATS:
+        page_stats = true;
+        if (optarg) {
+          page_stats_top_n = parse_u64_option("page-stats", optarg);
+        }
+        break;
+      case OPT_REUSE:
+        reuse_path = optarg;
+        break;
+      case OPT_WSS: {
+        size_t length = strlen(optarg);
+        if (length > 2 && strcmp(optarg + length - 2, "ns") == 0) {
+          wss_unit = WSS_WINDOW_NS;
+          optarg[length - 2] = '\0';
+        }
+        wss_window = parse_u64_option("wss", optarg);
+        break;
+      }
+      case OPT_WSS_STEP:
+        wss_step = parse_u64_option("wss-step", optarg);
+        break;
+      case OPT_WSS_OUT:
+        wss_path = optarg;
+        break;
+      case OPT_STATS_JSON:
+        stats_json_path = optarg;
+        break;
+      case OPT_STATS_CSV:
+        stats_csv_path = optarg;
+        break;
+      case OPT_PROGRESS:
+        progress_interval = optarg ? parse_u64_option("progress", optarg)
+                                   : PROGRESS_DEFAULT_INTERVAL_S;
+        break;
+      case OPT_SNAPSHOT:
+        snapshot_path = optarg;
+        break;
+      case OPT_TIMELINE:
+        timeline_path = optarg;
+        break;
+      case OPT_TIMELINE_SAMPLE:
+        timeline_sample = parse_u64_option("timeline-sample", optarg);
+        break;
+      case OPT_REGIONS:
+        regions_path = optarg;
+        break;
+      case OPT_REGIONS_AUTO:
+        regions_auto_gap = optarg ? parse_u64_option("regions-auto", optarg)
+                                  : REGION_AUTO_DEFAULT_GAP_BYTES;
+        regions_auto = true;
+        break;
+      case OPT_ACCESS_STREAM:
+        access_stream_path = optarg;
+        break;
+      case OPT_ACCESS_STREAM_SAMPLE:
+        access_stream_sample =
+            parse_u64_option("access-stream-sample", optarg);
+        break;
+      case OPT_EXACT_EVICTIONS:
+        exact_evictions = true;
+        break;
+      case OPT_ZERO_PAGE:
+        zero_page = true;
+        break;
+      case OPT_NUMA: {
+        char* separator = strchr(optarg, ':');
+        if (separator) {
+          *separator = '\0';
+          numa_cores_per_node = parse_u64_option("numa", separator + 1);
+        }
+        numa_nodes = parse_u64_option("numa", optarg);
+        numa = true;
+        break;
+      }
+      case OPT_NUMA_POLICY:
+        if (strcmp(optarg, "first-touch") == 0) {
+          numa_policy = NUMA_FIRST_TOUCH;
+        } else if (strcmp(optarg, "interleave") == 0) {
+          numa_policy = NUMA_INTERLEAVE;
+        } else if (strncmp(optarg, "preferred", 9) == 0 &&
+                   (optarg[9] == '\0' || optarg[9] == ':')) {
+          numa_policy = NUMA_PREFERRED;
+          if (optarg[9] == ':') {
+            numa_preferred_node = parse_u64_option("numa-policy", optarg + 10);
+          }
+        } else {
+          panic("Invalid value for --numa-policy: %s", optarg);
+        }
+        break;
+      case OPT_NUMA_REMOTE_LATENCY:
+        numa_remote_latency = parse_u64_option("numa-remote-latency", optarg);
+        break;
+      case OPT_NUMA_BALANCE:
+        numa_balance = optarg ? parse_u64_option("numa-balance", optarg)
+                              : NUMA_BALANCE_DEFAULT_THRESHOLD;
+        break;
+      case OPT_TIER: {
+        char* separator = strchr(optarg, ':');
+        if (separator) {
+          *separator = '\0';
+          tier_latency = parse_u64_option("tier", separator + 1);
+        }
+        tier_pages = parse_u64_option("tier", optarg);
+        tier = true;
+        break;
+      }
+      case OPT_TIER_HOT:
+        tier_hot = parse_u64_option("tier-hot", optarg);
+        break;
+      case OPT_TIER_PROMOTE_RATE:
+        tier_promote_rate = parse_u64_option("tier-promote-rate", optarg);
+        break;
+      case OPT_ZSWAP: {
+        char* separator = strchr(optarg, ':');
+        if (separator) {
+          *separator = '\0';
+          zswap_latency = parse_u64_option("zswap", separator + 1);
+        }
+        zswap_pages = parse_u64_option("zswap", optarg);
+        zswap = true;
+        break;
+      }
+      case OPT_ZSWAP_RATIO:
+        zswap_ratio = parse_u64_option("zswap-ratio", optarg);
+        break;
+      case OPT_THP:
+        thp = true;
+        if (optarg) {
+          char* separator = strchr(optarg, ':');
+          if (separator) {
+            *separator = '\0';
+            thp_scan_regions = parse_u64_option("thp", separator + 1);
+          }
+          thp_scan_period = parse_u64_option("thp", optarg);
+        }
+        break;
+      case OPT_COLT:
+        colt_pages = optarg ? parse_u64_option("colt", optarg)
+                            : TLB_COALESCE_DEFAULT_PAGES;
+        colt = true;
+        break;
+      case OPT_SEGMENTS:
+        segments_path = optarg;
+        break;
+      case OPT_PT_LEVELS:
+        pt_levels = parse_u64_option("pt-levels", optarg);
+        break;
+      case OPT_PWC:
+        pwc = true;
+        if (optarg) {
+          char* separator = strchr(optarg, ':');
+          if (separator) {
+            *separator = '\0';
+            pwc_latency = parse_u64_option("pwc", separator + 1);
+          }
+          pwc_sizes = 0;
+          for (char* size = strtok(optarg, ","); size;
+               size = strtok(NULL, ",")) {
+            if (pwc_sizes == PT_MAX_LEVELS) {
+              panic("--pwc: at most %d sizes", PT_MAX_LEVELS);
+            }
+            pwc_entries[pwc_sizes++] = parse_u64_option("pwc", size);
+          }
+          if (pwc_sizes == 0) {
+            panic("Invalid value for --pwc: %s", optarg);
+          }
+        }
+        break;
+      case OPT_PWC_POLICY:
+        if (strcmp(optarg, "lru") == 0) {
+          pwc_policy = PWC_LRU;
+        } else if (strcmp(optarg, "fifo") == 0) {
+          pwc_policy = PWC_FIFO;
+        } else if (strcmp(optarg, "random") == 0) {
+          pwc_policy = PWC_RANDOM;
+        } else {
+          panic("Invalid value for --pwc-policy: %s", optarg);
+        }
+        break;
+      case OPT_CACHE:
+        cache_level_count =
+            optarg ? parse_cache_levels(optarg, cache_levels) : 3;
+        break;
+      case OPT_CACHE_POLICY:
+        if (strcmp(optarg, "lru") == 0) {
+          cache_policy = CACHE_LRU;
+        } else if (strcmp(optarg, "plru") == 0) {
+          cache_policy = CACHE_PLRU;
+        } else {
+          panic("Invalid value for --cache-policy: %s", optarg);
+        }
+        break;
+      case OPT_NESTED:
+        nested = true;
+        if (strcmp(optarg, "ept") == 0) {
+          nested_mode = NESTED_EPT;
+        } else if (strcmp(optarg, "ept-huge") == 0) {
+          nested_mode = NESTED_EPT;
+          nested_huge_host_pages = true;
+        } else if (strcmp(optarg, "shadow") == 0) {
+          nested_mode = NESTED_SHADOW;
+        } else {
+          panic("Invalid value for --nested: %s", optarg);
+        }
+        break;
+      case OPT_HOST_PT_LEVELS:
+        host_pt_levels = parse_u64_option("host-pt-levels", optarg);
+        break;
+      case OPT_NTLB:
+        nested_tlb_entries = parse_u64_option("ntlb", optarg);
+        break;
+      case OPT_HW_DIRTY_BITS:
+        hw_dirty_bits = true;
+        break;
+      case OPT_WCB:
+        wcb = true;
+        if (optarg) {
+          wcb_entries = parse_u64_option("wcb", optarg);
+        }
+        break;
+      case OPT_TIMELINE_RANGE: {
+        char* separator = strchr(optarg, ':');
+        if (!separator) {
+          panic("Invalid value for --timeline-range: %s", optarg);
+        }
+        *separator = '\0';
+        if (*optarg) {
+          timeline_start = parse_u64_option("timeline-range", optarg);
+        }
+        if (separator[1]) {
+          timeline_end = parse_u64_option("timeline-range", separator + 1);
+        }
+        break;
+      }
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        panic("Invalid command line");
+    }
+  }
+
+  if (optind >= argc) {
+    panic("Usage: %s [options] <instructions_file>", argv[0]);
   }
+  const char* instructions_path = argv[optind];
 
   srand(0xcafebabe);
   reset_time();
+  memory_init();
   page_table_init();
   tlb_init();
+  if (exact_evictions || zero_page || numa || tier ||
+      zswap || thp || colt || segments_path ||
+      trace_moves_frames(instructions_path)) {
+    page_table_enable_exact_evictions();
+  }
+  if (zero_page) {
+    page_table_enable_zero_page();
+  }
+  if (numa) {
+    numa_enable(numa_nodes, numa_cores_per_node, numa_policy,
+                numa_preferred_node, numa_remote_latency, numa_balance);
+  }
+  if (tier) {
+    tier_enable(tier_pages, tier_latency, tier_hot, tier_promote_rate);
+  }
+  if (zswap) {
+    zswap_enable(zswap_pages, zswap_latency);
+    zswap_set_ratio(zswap_ratio);
+  }
+  if (thp) {
+    thp_enable(thp_scan_period, thp_scan_regions);
+  }
+  if (colt) {
+    tlb_enable_coalescing(colt_pages);
+    page_table_enable_contiguity_hint();
+  }
+  if (hw_dirty_bits) {
+    tlb_enable_hardware_dirty_bits();
+  }
+  if (wcb) {
+    wcb_enable(wcb_entries);
+  }
+  if (pt_levels != 1) {
+    page_table_set_levels((uint32_t)pt_levels);
+  }
+  if (pwc) {
+    pwc_enable(pwc_entries, pwc_sizes, pwc_latency, pwc_policy);
+  }
+  if (cache_level_count) {
+    cache_enable(cache_levels, cache_level_count, cache_policy);
+  }
+  if (nested) {
+    nested_enable(nested_mode, (uint32_t)host_pt_levels,
+                  nested_huge_host_pages, nested_tlb_entries);
+  }
+  if (segments_path) {
+    segment_load(segments_path);
+  }
+  if (page_stats) {
+    page_stats_enable(page_stats_top_n);
+  }
+  if (reuse_path) {
+    reuse_enable(reuse_path);
+  }
+  if (regions_path && regions_auto) {
+    panic("--regions and --regions-auto are mutually exclusive");
+  }
+  if (regions_path) {
+    region_load(regions_path);
+  } else if (regions_auto) {
+    region_enable_auto(regions_auto_gap);
+  }
+  if (access_stream_path) {
+    access_stream_enable(access_stream_path, access_stream_sample);
+  }
+  if (timeline_path) {
+    timeline_enable(timeline_path, timeline_sample, timeline_start,
+                    timeline_end);
+  }
+  if (wss_window) {
+    wss_enable(wss_unit, wss_window, wss_step, wss_path);
+  }
 
-  FILE* file = fopen(argv[1], "r");
+  FILE* file = fopen(instructions_path, "r");
   if (!file) {
-    panic("Failed to open instructions file %s", argv[1]);
+    panic("Failed to open instructions file %s", instructions_path);
   }
 
   uint64_t total_instructions = 0;
+  progress_init(file, progress_interval, snapshot_path);
+
+  stats_register_config_string("sim.instructions_file", instructions_path);
+  stats_register_config("sim.detailed", detailed);
+  stats_register_config("sim.page_stats", page_stats);
+  stats_register_config_string("sim.reuse", reuse_path);
+  stats_register_config("sim.wss_window", wss_window);
+  stats_register_config_string("sim.wss_unit",
+                               wss_unit == WSS_WINDOW_NS ? "ns" : "accesses");
+  stats_register_config("sim.wss_step", wss_step ? wss_step : wss_window);
+  stats_register_config("sim.zero_page", zero_page);
+  stats_register_counter("sim.instructions", &total_instructions);
 
   char line[256];
-  while (fgets(line, sizeof(line), file)) {
+  while (!progress_interrupted()) {
     char instruction;
     uint64_t address;
-    if (sscanf(line, "%c %" PRIx64, &instruction, &address) != 2) {
-      panic("Invalid instruction format: %s", line);
+    uint64_t length = 0;
+    char flags[16] = "";
+    int operands;
+    {
+      PROFILE_SCOPE(PROFILE_PARSE);
+      if (!fgets(line, sizeof(line), file)) {
+        break;
+      }
+      operands = sscanf(line, "%c %" SCNx64 " %" SCNx64 " %15s", &instruction,
+                        &address, &length, flags) - 1;
+      if (operands < 1) {
+        panic("Invalid instruction format: %s", line);
+      }
+      if ((instruction == 'F' || instruction == 'M' || instruction == 'D') &&
+          operands < 2) {
+        panic("Missing length: %s", line);
+      }
     }
 
-    log_dbg("* %c %" PRIx64, instruction, address);
+    {
+      PROFILE_SCOPE(PROFILE_LOGGING);
+      log_dbg("* %c %" PRIx64, instruction, address);
+    }
 
     switch (instruction) {
       case 'R':
@@ -54,14 +808,51 @@ int main(int argc, char* argv[]) {
       case 'W':
         write(address);
         break;
+      case 'P':
+        prefetch(address);
+        break;
+      case 'F':
+        page_table_unmap(address, length);
+        break;
+      case 'M':
+        page_table_map(address, length, parse_map_flags(flags, line));
+        break;
+      case 'C':
+        page_table_switch(parse_asid(address, line));
+        break;
+      case 'K':
+        page_table_fork(parse_asid(address, line));
+        break;
+      case 'S':
+        numa_set_core(address);
+        break;
+      case 'Z':
+        zswap_set_ratio(address);
+        break;
+      case 'D': {
+        char* end;
+        uint64_t physical_base = strtoull(flags, &end, 16);
+        if (operands < 3 || *end != '\0') {
+          panic("Missing or invalid physical address: %s", line);
+        }
+        segment_add(address, address + length, physical_base);
+        break;
+      }
       default:
         panic("Unknown instruction: %c", instruction);
     }
 
     total_instructions++;
+    progress_poll(total_instructions);
+  }
+
+  if (progress_interrupted()) {
+    log_dbg("Interrupted after %" PRIu64 " instructions, reporting partial "
+            "results", total_instructions);
   }
 
   fclose(file);
+  wcb_drain();
 
   time_ns_t elapsed_time = get_time();
   uint64_t page_faults = get_total_page_faults();
@@ -89,5 +880,76 @@ int main(int argc, char* argv[]) {
   log("Total TLB L1 invalidations: %" PRIu64, l1_invalidations);
   log("Total TLB L2 invalidations: %" PRIu64, l2_invalidations);
 
+  if (detailed) {
+    log("Total major page faults: %" PRIu64, get_total_major_page_faults());
+    log("Total minor page faults: %" PRIu64, get_total_minor_page_faults());
+    log("Total time in major page faults: %" PRIu64 " ns",
+        get_total_major_fault_time());
+    log("Total time in minor page faults: %" PRIu64 " ns",
+        get_total_minor_fault_time());
+    log("Total zero page mappings: %" PRIu64 " (%" PRIu64 " later written)",
+        get_total_zero_page_maps(), get_total_zero_page_fills());
+    log("Total clean page evictions: %" PRIu64,
+        get_total_clean_page_evictions());
+    log("Total dirty page evictions: %" PRIu64,
+        get_total_dirty_page_evictions());
+    log("Total page table DRAM reads: %" PRIu64, get_total_page_table_reads());
+    log("Total page table DRAM writes: %" PRIu64,
+        get_total_page_table_writes());
+    log("Total DRAM reads: %" PRIu64, get_total_dram_reads());
+    log("Total DRAM writes: %" PRIu64, get_total_dram_writes());
+    log("Total disk reads: %" PRIu64, get_total_disk_reads());
+    log("Total disk writes: %" PRIu64, get_total_disk_writes());
+    log("Total TLB write-backs to page table: %" PRIu64,
+        get_total_tlb_write_backs());
+    if (hw_dirty_bits) {
+      log("Total hardware dirty-bit updates: %" PRIu64,
+          get_total_dirty_bit_updates());
+    }
+    log("Total TLB L1 clean evictions: %" PRIu64,
+        get_total_tlb_l1_clean_evictions());
+    log("Total TLB L1 dirty evictions (spills to L2): %" PRIu64,
+        get_total_tlb_l1_dirty_evictions());
+    log("Total TLB L2 clean evictions: %" PRIu64,
+        get_total_tlb_l2_clean_evictions());
+    log("Total TLB L2 dirty evictions: %" PRIu64,
+        get_total_tlb_l2_dirty_evictions());
+    log("Total TLB L1 invalidation write-backs: %" PRIu64,
+        get_total_tlb_l1_invalidation_write_backs());
+    log("Total TLB L2 invalidation write-backs: %" PRIu64,
+        get_total_tlb_l2_invalidation_write_backs());
+    log("Total COW faults: %" PRIu64 " (%" PRIu64 " copies, %" PRIu64
+        " reuses)",
+        get_total_cow_faults(), get_total_cow_copies(), get_total_cow_reuses());
+    log("Total TLB write-protect faults: %" PRIu64,
+        get_total_tlb_write_protect_faults());
+    log("Total file page-ins: %" PRIu64, get_total_file_page_ins());
+    log("Total file write-backs: %" PRIu64, get_total_file_write_backs());
+    log("Total clean file page drops: %" PRIu64, get_total_file_page_drops());
+  }
+
+  page_stats_report();
+  reuse_report();
+  wss_report();
+  region_report();
+  numa_report();
+  tier_report();
+  zswap_report();
+  thp_report();
+  segment_report();
+  pwc_report();
+  nested_report();
+  cache_report();
+  wcb_report();
+  if (thp || colt) {
+    tlb_reach_report();
+  }
+  PROFILE_REPORT();
+
+  timeline_close();
+  access_stream_close();
+
+  stats_export(stats_json_path, stats_csv_path);
+
   return 0;
 }
\ No newline at end of file
@@ -1,12 +1,58 @@
 #include "memory.h"
 
+#include "access_stream.h"
+#include "cache.h"
 #include "clock.h"
 #include "constants.h"
 #include "log.h"
+#include "numa.h"
+#include "page_stats.h"
 #include "page_table.h"
+#include "profile.h"
+#include "region.h"
+#include "reuse.h"
+#include "stats.h"
+#include "thp.h"
+#include "timeline.h"
+#include "tier.h"
 #include "tlb.h"
+#include "wss.h"
+
+uint64_t data_reads = 0;
+uint64_t data_writes = 0;
+uint64_t dram_reads = 0;
+uint64_t dram_writes = 0;
+uint64_t disk_reads = 0;
+uint64_t disk_writes = 0;
+
+void memory_init() {
+  data_reads = 0;
+  data_writes = 0;
+  dram_reads = 0;
+  dram_writes = 0;
+  disk_reads = 0;
+  disk_writes = 0;
+
+  stats_register_config("memory.virtual_address_bits", VIRTUAL_ADDRESS_BITS);
+  stats_register_config("memory.dram_address_bits", DRAM_ADDRESS_BITS);
+  stats_register_config("memory.disk_address_bits", DISK_ADDRESS_BITS);
+  stats_register_config("memory.dram_latency_ns", DRAM_LATENCY_NS);
+  stats_register_config("memory.disk_latency_ns", DISK_LATENCY_NS);
+  stats_register_counter("memory.data_reads", &data_reads);
+  stats_register_counter("memory.data_writes", &data_writes);
+  stats_register_counter("memory.dram_reads", &dram_reads);
+  stats_register_counter("memory.dram_writes", &dram_writes);
+  stats_register_counter("memory.disk_reads", &disk_reads);
+  stats_register_counter("memory.disk_writes", &disk_writes);
+}
 
 void log_dram_access(pa_dram_t address, op_t op) {
+  PROFILE_SCOPE(PROFILE_LOGGING);
+  if (tier_contains(address)) {
+    log_clk("%c Tier[%" PRIx64 "]", op == OP_WRITE ? 'W' : 'R',
+            address - DRAM_SIZE_BYTES);
+    return;
+  }
   address &= DRAM_ADDRESS_MASK;
   switch (op) {
     case OP_READ:
@@ -19,6 +65,7 @@ void log_dram_access(pa_dram_t address, op_t op) {
 }
 
 void log_disk_access(pa_disk_t address, op_t op) {
+  PROFILE_SCOPE(PROFILE_LOGGING);
   address &= DISK_ADDRESS_MASK;
   switch (op) {
     case OP_READ:
@@ -30,24 +77,70 @@ void log_disk_access(pa_disk_t address, op_t op) {
   }
 }
 
-void read(va_t address) {
+static void memory_access(va_t address, op_t op) {
   address &= VIRTUAL_ADDRESS_MASK;
-  pa_dram_t physical_address = tlb_translate(address, OP_READ);
-  log_dram_access(physical_address, OP_READ);
-}
+  if (op == OP_WRITE) {
+    data_writes++;
+  } else {
+    data_reads++;
+  }
+  va_t virtual_page_number = address >> PAGE_SIZE_BITS;
+  page_stats_record_access(virtual_page_number, op);
+  reuse_record_access(virtual_page_number, get_time());
+  wss_record_access(virtual_page_number, get_time());
 
-void write(va_t address) {
-  address &= VIRTUAL_ADDRESS_MASK;
-  pa_dram_t physical_address = tlb_translate(address, OP_WRITE);
-  log_dram_access(physical_address, OP_WRITE);
+  time_ns_t start = get_time();
+  region_access_begin(address, op);
+  timeline_access_begin();
+  access_stream_begin();
+  pa_dram_t physical_address = tlb_translate(address, op);
+  log_dram_access(physical_address, op);
+  cache_access(physical_address, op, CACHE_DATA);
+  numa_record_data_access(virtual_page_number, physical_address);
+  tier_record_data_access(virtual_page_number, physical_address);
+  timeline_access_end(op == OP_WRITE ? "write" : "read", start, address,
+                      physical_address);
+  region_access_end(get_time() - start);
+  access_stream_end(address, physical_address, op, get_time() - start);
+  thp_record_access();
 }
 
+void read(va_t address) { memory_access(address, OP_READ); }
+
+void write(va_t address) { memory_access(address, OP_WRITE); }
+
+void prefetch(va_t address) { tlb_prefetch(address & VIRTUAL_ADDRESS_MASK); }
+
 void dram_access(pa_dram_t address, op_t op) {
+  if (tier_contains(address)) {
+    log_dram_access(address, op);
+    tier_access(op);
+    return;
+  }
+  if (op == OP_WRITE) {
+    dram_writes++;
+  } else {
+    dram_reads++;
+  }
   log_dram_access(address, op);
   increment_time(DRAM_LATENCY_NS);
+  numa_charge_dram_access(address);
 }
 
 void disk_access(pa_disk_t address, op_t op) {
+  if (op == OP_WRITE) {
+    disk_writes++;
+  } else {
+    disk_reads++;
+  }
+  time_ns_t start = get_time();
   log_disk_access(address, op);
   increment_time(DISK_LATENCY_NS);
+  timeline_complete(op == OP_WRITE ? "disk_write" : "disk_read", start,
+                    "address", address);
 }
+
+uint64_t get_total_dram_reads() { return dram_reads; }
+uint64_t get_total_dram_writes() { return dram_writes; }
+uint64_t get_total_disk_reads() { return disk_reads; }
+uint64_t get_total_disk_writes() { return disk_writes; }
@@ -16,7 +16,16 @@ typedef uint64_t pa_disk_t;
 
 typedef enum { OP_READ, OP_WRITE } op_t;
 
+void memory_init();
 void read(va_t address);
 void write(va_t address);
+void prefetch(va_t address);
 void dram_access(pa_dram_t address, op_t op);
-void disk_access(pa_disk_t address, op_t op);
\ No newline at end of file
+void disk_access(pa_disk_t address, op_t op);
+
+// Number of dram_access()/disk_access() calls, by direction. Data accesses
+// from read()/write() are not included (they are not charged any latency).
+uint64_t get_total_dram_reads();
+uint64_t get_total_dram_writes();
+uint64_t get_total_disk_reads();
+uint64_t get_total_disk_writes();
\ No newline at end of file
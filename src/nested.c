@@ -0,0 +1,229 @@
+#include "nested.h"
+
+#include <stdlib.h>
+
+#include "cache.h"
+#include "clock.h"
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+
+// The host page table's DRAM traffic is accounted to the frame holding the
+// guest's (see page_table.c).
+#define HOST_PAGE_TABLE_DRAM_ADDRESS (0)
+
+typedef struct {
+  bool valid;
+  uint64_t tag;  // Guest-physical page (or huge page) number.
+  uint64_t stamp;
+} nested_tlb_entry_t;
+
+bool nested_enabled = false;
+nested_mode_t nested_mode = NESTED_EPT;
+uint32_t nested_host_levels = 0;
+bool nested_huge_host_pages = false;
+
+nested_tlb_entry_t* nested_tlb = NULL;
+uint64_t nested_tlb_size = 0;
+uint64_t nested_tlb_tick = 0;
+
+bool nested_walk_open = false;
+uint64_t nested_walk_references = 0;
+
+uint64_t nested_walks = 0;
+uint64_t nested_guest_references = 0;
+uint64_t nested_host_references = 0;
+uint64_t nested_max_walk_references = 0;
+uint64_t nested_tlb_hits = 0;
+uint64_t nested_tlb_misses = 0;
+uint64_t nested_vm_exits = 0;
+time_ns_t nested_time = 0;
+
+static const char* nested_mode_name() {
+  if (nested_mode == NESTED_SHADOW) return "shadow paging";
+  return nested_huge_host_pages ? "nested paging, huge host pages"
+                                : "nested paging";
+}
+
+void nested_enable(nested_mode_t mode, uint32_t levels, bool huge_pages,
+                   uint64_t nested_tlb_entries) {
+  if (levels < 1 || levels > NESTED_MAX_HOST_LEVELS) {
+    panic("--host-pt-levels: between 1 and %d levels", NESTED_MAX_HOST_LEVELS);
+  }
+  if (huge_pages && levels < 2) {
+    panic("--nested=ept-huge: huge host pages need at least 2 host levels");
+  }
+  nested_enabled = true;
+  nested_mode = mode;
+  nested_host_levels = levels;
+  nested_huge_host_pages = huge_pages;
+  if (mode == NESTED_EPT && nested_tlb_entries) {
+    nested_tlb_size = nested_tlb_entries;
+    nested_tlb = calloc(nested_tlb_entries, sizeof(nested_tlb_entry_t));
+    if (!nested_tlb) {
+      panic("Out of memory allocating the nested TLB");
+    }
+  }
+
+  stats_register_config_string("nested.mode", nested_mode_name());
+  stats_register_config("nested.host_levels", levels);
+  stats_register_config("nested.tlb_entries", nested_tlb_size);
+  stats_register_counter("nested.walks", &nested_walks);
+  stats_register_counter("nested.guest_references",
+                         &nested_guest_references);
+  stats_register_counter("nested.host_references", &nested_host_references);
+  stats_register_counter("nested.max_walk_references",
+                         &nested_max_walk_references);
+  stats_register_counter("nested.tlb_hits", &nested_tlb_hits);
+  stats_register_counter("nested.tlb_misses", &nested_tlb_misses);
+  stats_register_counter("nested.vm_exits", &nested_vm_exits);
+  stats_register_counter("nested.time_ns", &nested_time);
+}
+
+bool nested_is_enabled() { return nested_enabled; }
+
+// Looks the page up in the nested TLB, filling it on a miss (LRU).
+static bool nested_tlb_lookup(uint64_t tag) {
+  nested_tlb_entry_t* victim = &nested_tlb[0];
+  for (uint64_t i = 0; i < nested_tlb_size; i++) {
+    nested_tlb_entry_t* entry = &nested_tlb[i];
+    if (entry->valid && entry->tag == tag) {
+      entry->stamp = ++nested_tlb_tick;
+      return true;
+    }
+    if (!entry->valid || (victim->valid && entry->stamp < victim->stamp)) {
+      victim = entry;
+    }
+  }
+  *victim = (nested_tlb_entry_t){true, tag, ++nested_tlb_tick};
+  return false;
+}
+
+// Where a host page table entry sits for the CPU caches, clear of both data
+// and guest page table addresses.
+static uint64_t host_entry_address(uint64_t guest_page_number,
+                                   uint32_t level) {
+  return (1llu << 62) | (uint64_t)level << 56 |
+         (guest_page_number >> (PT_LEVEL_BITS * (level - 1))) *
+             PTE_SIZE_BYTES;
+}
+
+// Walks the host page table for a guest-physical address, unless the nested
+// TLB has the translation.
+static void host_translate(uint64_t guest_physical_address) {
+  uint64_t guest_page_number = guest_physical_address >> PAGE_SIZE_BITS;
+  uint32_t leaf_level = nested_huge_host_pages ? 2 : 1;
+  if (nested_tlb) {
+    uint64_t tag = guest_page_number >> (PT_LEVEL_BITS * (leaf_level - 1));
+    if (nested_tlb_lookup(tag)) {
+      nested_tlb_hits++;
+      return;
+    }
+    nested_tlb_misses++;
+  }
+
+  time_ns_t start = get_time();
+  for (uint32_t level = nested_host_levels; level >= leaf_level; level--) {
+    nested_walk_references++;
+    nested_host_references++;
+    if (!cache_access(host_entry_address(guest_page_number, level), OP_READ,
+                      CACHE_PAGE_TABLE)) {
+      dram_access(HOST_PAGE_TABLE_DRAM_ADDRESS, OP_READ);
+    }
+  }
+  nested_time += get_time() - start;
+}
+
+static void close_walk() {
+  if (!nested_walk_open) return;
+  nested_walk_open = false;
+  nested_walks++;
+  if (nested_walk_references > nested_max_walk_references) {
+    nested_max_walk_references = nested_walk_references;
+  }
+}
+
+void nested_walk_begin() {
+  if (!nested_enabled) return;
+  close_walk();
+  nested_walk_open = true;
+  nested_walk_references = 0;
+}
+
+void nested_walk_read(uint64_t guest_physical_address) {
+  if (!nested_enabled) return;
+  nested_walk_references++;
+  nested_guest_references++;
+  if (nested_mode == NESTED_EPT) {
+    host_translate(guest_physical_address);
+  }
+}
+
+void nested_walk_end(pa_dram_t guest_physical_address) {
+  if (!nested_enabled) return;
+  if (nested_mode == NESTED_EPT) {
+    host_translate(guest_physical_address);
+  }
+  close_walk();
+}
+
+static void vm_exit() {
+  nested_vm_exits++;
+  increment_time(VM_EXIT_LATENCY_NS);
+  nested_time += VM_EXIT_LATENCY_NS;
+}
+
+void nested_record_page_table_write() {
+  if (nested_enabled && nested_mode == NESTED_SHADOW) {
+    vm_exit();
+  }
+}
+
+void nested_record_switch() {
+  if (nested_enabled && nested_mode == NESTED_SHADOW) {
+    vm_exit();
+  }
+}
+
+void nested_report() {
+  if (!nested_enabled) return;
+  close_walk();
+
+  uint32_t guest_levels = page_table_levels();
+  time_ns_t total_time = get_time();
+  log("=========== Virtualization Statistics ===========");
+  if (nested_mode == NESTED_SHADOW) {
+    log("  Mode: %s, %" PRIu32 "-level guest page table", nested_mode_name(),
+        guest_levels);
+  } else {
+    log("  Mode: %s, %" PRIu32 "-level guest and %" PRIu32
+        "-level host page tables",
+        nested_mode_name(), guest_levels, nested_host_levels);
+    // Host walks stop at the leaf level, level 2 with huge host pages.
+    uint32_t host_walk_levels =
+        nested_host_levels - (nested_huge_host_pages ? 2 : 1) + 1;
+    log("  References per walk: at most %" PRIu32,
+        (guest_levels + 1) * (host_walk_levels + 1) - 1);
+  }
+  uint64_t references = nested_guest_references + nested_host_references;
+  log("  Walks: %" PRIu64 ", %.2f references each (max %" PRIu64 ")",
+      nested_walks, nested_walks ? (double)references / nested_walks : 0.0,
+      nested_max_walk_references);
+  log("  Guest page table references: %" PRIu64, nested_guest_references);
+  log("  Host page table references: %" PRIu64, nested_host_references);
+  if (nested_tlb) {
+    uint64_t lookups = nested_tlb_hits + nested_tlb_misses;
+    log("  Nested TLB: %" PRIu64 " entries, %" PRIu64 " hits of %" PRIu64
+        " (%.2f%%)",
+        nested_tlb_size, nested_tlb_hits, lookups,
+        lookups ? 100.0 * nested_tlb_hits / lookups : 0.0);
+  }
+  if (nested_mode == NESTED_SHADOW) {
+    log("  VM exits: %" PRIu64 " (%d ns each)", nested_vm_exits,
+        VM_EXIT_LATENCY_NS);
+  }
+  log("  Virtualization overhead: %" PRIu64 " ns (%.2f%% of the time)",
+      nested_time, total_time ? 100.0 * nested_time / total_time : 0.0);
+  log("=================================================");
+}
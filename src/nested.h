@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Nested paging for a virtualized guest.
+// The simulated page table becomes the guest's, mapping guest-virtual pages
+// to guest-physical frames; a host page table maps guest-physical memory
+// onto host memory, one to one (its entries are not stored, only their
+// reads are modelled). With EPT-style nested paging, every guest page table
+// entry read by a walk sits at a guest-physical address that the host table
+// has to translate first, and so does the data page it leads to: a walk of
+// G guest levels over H host levels makes up to (G + 1) * (H + 1) - 1
+// references. A nested TLB caches guest-physical to host-physical
+// translations, and huge host pages shorten host walks by a level. Under
+// shadow paging the hardware walks a shadow table shaped like the guest's,
+// a one-dimensional walk, but every guest page table write and address
+// space switch exits to the hypervisor to keep the shadow in sync.
+// The TLB caches complete guest-virtual to host-physical translations.
+
+typedef enum {
+  NESTED_EPT,
+  NESTED_SHADOW,
+} nested_mode_t;
+
+void nested_enable(nested_mode_t mode, uint32_t host_levels,
+                   bool huge_host_pages, uint64_t nested_tlb_entries);
+bool nested_is_enabled();
+
+// A page walk starts, reads a guest page table entry, and ends with the
+// guest-physical address it translated to.
+void nested_walk_begin();
+void nested_walk_read(uint64_t guest_physical_address);
+void nested_walk_end(pa_dram_t guest_physical_address);
+
+// The guest wrote one of its page table entries, or switched address
+// spaces.
+void nested_record_page_table_write();
+void nested_record_switch();
+
+// Walk references, nested TLB hit rate and the time translation spent on
+// virtualization.
+void nested_report();
@@ -0,0 +1,242 @@
+#include "numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+
+typedef struct {
+  uint64_t allocations;      // Frames handed out from this node's pool.
+  uint64_t local_accesses;   // DRAM accesses by this node's cores to itself.
+  uint64_t remote_accesses;  // DRAM accesses by this node's cores elsewhere.
+  uint64_t migrations_in;    // Pages balancing moved to this node.
+} numa_node_t;
+
+// Balancing state per frame: the remote node that touched it last, and how
+// many times in a row.
+typedef struct {
+  uint8_t node;
+  uint8_t streak;
+} numa_hint_t;
+
+bool numa_enabled = false;
+uint32_t numa_nodes = 1;
+uint32_t numa_cores_per_node = 1;
+numa_policy_t numa_policy = NUMA_FIRST_TOUCH;
+uint32_t numa_preferred_node = 0;
+time_ns_t numa_remote_penalty = 0;
+uint64_t numa_balance_threshold = 0;
+uint32_t numa_current_node = 0;
+pa_dram_t numa_frames_per_node = DRAM_PAGE_CAPACITY;
+
+numa_node_t numa_node_stats[NUMA_MAX_NODES];
+numa_hint_t* numa_hints = NULL;
+
+uint64_t numa_local_accesses = 0;
+uint64_t numa_remote_accesses = 0;
+uint64_t numa_migrations = 0;
+uint64_t numa_failed_migrations = 0;
+
+static const char* numa_policy_name(numa_policy_t policy) {
+  switch (policy) {
+    case NUMA_FIRST_TOUCH:
+      return "first-touch";
+    case NUMA_INTERLEAVE:
+      return "interleave";
+    case NUMA_PREFERRED:
+      return "preferred";
+  }
+  return "?";
+}
+
+static void numa_register_node_counter(uint32_t node, int index,
+                                       const char* field,
+                                       const uint64_t* counter) {
+  // Like region names, node names only exist at run time.
+  static char names[NUMA_MAX_NODES][4][48];
+  snprintf(names[node][index], sizeof(names[node][index]),
+           "numa.node%" PRIu32 ".%s", node, field);
+  stats_register_counter(names[node][index], counter);
+}
+
+static void numa_register_node_stats(uint32_t node) {
+  numa_node_t* stats = &numa_node_stats[node];
+  numa_register_node_counter(node, 0, "allocations", &stats->allocations);
+  numa_register_node_counter(node, 1, "local_accesses",
+                             &stats->local_accesses);
+  numa_register_node_counter(node, 2, "remote_accesses",
+                             &stats->remote_accesses);
+  numa_register_node_counter(node, 3, "migrations_in", &stats->migrations_in);
+}
+
+void numa_enable(uint64_t nodes, uint64_t cores_per_node,
+                 numa_policy_t policy, uint64_t preferred_node,
+                 time_ns_t remote_latency, uint64_t balance_threshold) {
+  if (nodes < 1 || nodes > NUMA_MAX_NODES) {
+    panic("--numa: between 1 and %d nodes are supported", NUMA_MAX_NODES);
+  }
+  if (cores_per_node < 1 || cores_per_node > UINT32_MAX) {
+    panic("--numa: between 1 and %" PRIu32 " cores per node", UINT32_MAX);
+  }
+  if (preferred_node >= nodes) {
+    panic("--numa-policy: preferred node %" PRIu64 " out of range",
+          preferred_node);
+  }
+  if (remote_latency < DRAM_LATENCY_NS) {
+    panic("--numa-remote-latency: remote accesses can't beat local ones (%d "
+          "ns)", DRAM_LATENCY_NS);
+  }
+  if (balance_threshold > UINT8_MAX) {
+    panic("--numa-balance: threshold at most %d", UINT8_MAX);
+  }
+
+  numa_enabled = true;
+  numa_nodes = (uint32_t)nodes;
+  numa_cores_per_node = (uint32_t)cores_per_node;
+  numa_policy = policy;
+  numa_preferred_node = (uint32_t)preferred_node;
+  numa_remote_penalty = remote_latency - DRAM_LATENCY_NS;
+  numa_balance_threshold = balance_threshold;
+  numa_current_node = 0;
+  numa_frames_per_node = DRAM_PAGE_CAPACITY / nodes;
+  memset(numa_node_stats, 0, sizeof(numa_node_stats));
+  if (balance_threshold) {
+    numa_hints = calloc(DRAM_PAGE_CAPACITY, sizeof(numa_hint_t));
+    if (!numa_hints) {
+      panic("Out of memory allocating NUMA balancing state");
+    }
+  }
+
+  stats_register_config("numa.nodes", nodes);
+  stats_register_config("numa.cores_per_node", cores_per_node);
+  stats_register_config_string("numa.policy", numa_policy_name(policy));
+  stats_register_config("numa.preferred_node", preferred_node);
+  stats_register_config("numa.remote_latency_ns", remote_latency);
+  stats_register_config("numa.balance_threshold", balance_threshold);
+  stats_register_counter("numa.local_accesses", &numa_local_accesses);
+  stats_register_counter("numa.remote_accesses", &numa_remote_accesses);
+  stats_register_counter("numa.migrations", &numa_migrations);
+  stats_register_counter("numa.failed_migrations", &numa_failed_migrations);
+  for (uint32_t node = 0; node < nodes; node++) {
+    numa_register_node_stats(node);
+  }
+}
+
+bool numa_is_enabled() { return numa_enabled; }
+
+void numa_set_core(uint64_t core) {
+  if (!numa_enabled) return;
+  numa_current_node = (uint32_t)((core / numa_cores_per_node) % numa_nodes);
+}
+
+uint32_t numa_node_count() { return numa_nodes; }
+
+uint32_t numa_placement_node(va_t virtual_page_number) {
+  if (!numa_enabled) return 0;
+  switch (numa_policy) {
+    case NUMA_FIRST_TOUCH:
+      return numa_current_node;
+    case NUMA_INTERLEAVE:
+      return virtual_page_number % numa_nodes;
+    case NUMA_PREFERRED:
+      return numa_preferred_node;
+  }
+  return 0;
+}
+
+void numa_node_frames(uint32_t node, pa_dram_t* first, pa_dram_t* end) {
+  *first = node * numa_frames_per_node;
+  // The last node also gets the remainder of an uneven split.
+  *end = node == numa_nodes - 1 ? DRAM_PAGE_CAPACITY
+                                : (node + 1) * numa_frames_per_node;
+}
+
+static uint32_t numa_node_of_frame(pa_dram_t frame) {
+  uint32_t node = frame / numa_frames_per_node;
+  return node < numa_nodes ? node : numa_nodes - 1;
+}
+
+void numa_record_allocation(pa_dram_t frame) {
+  if (!numa_enabled) return;
+  numa_node_stats[numa_node_of_frame(frame)].allocations++;
+  if (numa_hints) {
+    numa_hints[frame].streak = 0;
+  }
+}
+
+// Counts the access and charges the remote penalty. Returns the frame's node.
+static uint32_t numa_access(pa_dram_t address) {
+  uint32_t node = numa_node_of_frame((address & DRAM_ADDRESS_MASK) >>
+                                     PAGE_SIZE_BITS);
+  if (node == numa_current_node) {
+    numa_local_accesses++;
+    numa_node_stats[numa_current_node].local_accesses++;
+  } else {
+    numa_remote_accesses++;
+    numa_node_stats[numa_current_node].remote_accesses++;
+    increment_time(numa_remote_penalty);
+  }
+  return node;
+}
+
+void numa_charge_dram_access(pa_dram_t address) {
+  if (!numa_enabled) return;
+  numa_access(address);
+}
+
+void numa_record_data_access(va_t virtual_page_number, pa_dram_t address) {
+  // Slow-tier memory is not part of any node.
+  if (!numa_enabled || address >= DRAM_SIZE_BYTES) return;
+  uint32_t node = numa_access(address);
+  if (!numa_hints) return;
+
+  numa_hint_t* hint = &numa_hints[(address & DRAM_ADDRESS_MASK) >>
+                                  PAGE_SIZE_BITS];
+  if (node == numa_current_node) {
+    hint->streak = 0;
+    return;
+  }
+  if (hint->streak == 0 || hint->node != numa_current_node) {
+    hint->node = (uint8_t)numa_current_node;
+    hint->streak = 0;
+  }
+  if (++hint->streak < numa_balance_threshold) return;
+
+  hint->streak = 0;
+  if (page_table_migrate(virtual_page_number, numa_current_node)) {
+    numa_migrations++;
+    numa_node_stats[numa_current_node].migrations_in++;
+  } else {
+    numa_failed_migrations++;
+  }
+}
+
+void numa_report() {
+  if (!numa_enabled) return;
+
+  uint64_t total = numa_local_accesses + numa_remote_accesses;
+  log("============ NUMA Statistics ============");
+  log("  %" PRIu32 " nodes, %s placement, remote latency %" PRIu64 " ns",
+      numa_nodes, numa_policy_name(numa_policy),
+      numa_remote_penalty + DRAM_LATENCY_NS);
+  log("  Remote DRAM accesses: %" PRIu64 " of %" PRIu64 " (%.2f%%)",
+      numa_remote_accesses, total,
+      total ? 100.0 * numa_remote_accesses / total : 0.0);
+  if (numa_balance_threshold) {
+    log("  Balancing migrations: %" PRIu64 " (%" PRIu64 " failed)",
+        numa_migrations, numa_failed_migrations);
+  }
+  log("  %-6s %12s %14s %14s %10s", "Node", "Allocations", "Local", "Remote",
+      "Migr. in");
+  for (uint32_t node = 0; node < numa_nodes; node++) {
+    const numa_node_t* n = &numa_node_stats[node];
+    log("  %-6" PRIu32 " %12" PRIu64 " %14" PRIu64 " %14" PRIu64 " %10" PRIu64,
+        node, n->allocations, n->local_accesses, n->remote_accesses,
+        n->migrations_in);
+  }
+  log("=========================================");
+}
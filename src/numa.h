@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Multi-node (NUMA) DRAM.
+// DRAM frames are split into one contiguous pool per node, and each core
+// belongs to a node (cores_per_node consecutive cores per node). Frames are
+// placed according to a policy, and every DRAM access (data, page table,
+// copies) from the current core to another node's frame is charged the
+// remote latency on top of what a local access costs. With balancing on, a
+// page that keeps being accessed from the same remote node is migrated to
+// it, paying for the copy. Disabled, there is a single node and nothing
+// changes.
+
+typedef enum {
+  NUMA_FIRST_TOUCH,  // The node of the core that faults the page in.
+  NUMA_INTERLEAVE,   // Round-robin over the nodes, by virtual page number.
+  NUMA_PREFERRED,    // One node, falling back to the others when full.
+} numa_policy_t;
+
+// balance_threshold == 0 disables automatic balancing.
+void numa_enable(uint64_t nodes, uint64_t cores_per_node,
+                 numa_policy_t policy, uint64_t preferred_node,
+                 time_ns_t remote_latency, uint64_t balance_threshold);
+bool numa_is_enabled();
+
+// Trace "S <core>" records: the following accesses run on that core (cores
+// past the last one wrap around).
+void numa_set_core(uint64_t core);
+
+uint32_t numa_node_count();
+// Node a new frame for the page should come from.
+uint32_t numa_placement_node(va_t virtual_page_number);
+// Frames [*first, *end) belong to the node.
+void numa_node_frames(uint32_t node, pa_dram_t* first, pa_dram_t* end);
+
+void numa_record_allocation(pa_dram_t frame);
+// Any DRAM access charged by dram_access().
+void numa_charge_dram_access(pa_dram_t address);
+// Data access of the current instruction, once translated. Data accesses
+// are otherwise free, so only the remote penalty is charged.
+void numa_record_data_access(va_t virtual_page_number, pa_dram_t address);
+
+void numa_report();
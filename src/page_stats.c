@@ -0,0 +1,240 @@
+#include "page_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "vpn_map.h"
+
+typedef struct {
+  va_t virtual_page_number;
+  uint64_t accesses;
+  uint64_t writes;
+  uint64_t tlb_misses;
+  uint64_t faults;
+  uint64_t evictions;
+  uint64_t swap_ins;
+} page_stats_entry_t;
+
+typedef struct {
+  uint64_t accesses;
+  uint64_t tlb_misses;
+  uint64_t faults;
+  uint64_t pages;
+} page_stats_bin_t;
+
+bool page_stats_enabled = false;
+uint64_t page_stats_top_n = PAGE_STATS_DEFAULT_TOP_N;
+
+// VPN -> index into page_stats_entries. Records are kept densely packed (one
+// per touched page) so the report can scan them sequentially.
+vpn_map_t page_stats_index;
+page_stats_entry_t* page_stats_entries = NULL;
+uint64_t page_stats_count = 0;
+uint64_t page_stats_capacity = 0;
+
+void page_stats_enable(uint64_t top_n) {
+  if (top_n == 0) {
+    panic("--page-stats: must report at least 1 page");
+  }
+  page_stats_enabled = true;
+  page_stats_top_n = top_n;
+  page_stats_reset();
+}
+
+bool page_stats_is_enabled() { return page_stats_enabled; }
+
+void page_stats_reset() {
+  if (!page_stats_enabled) {
+    return;
+  }
+  if (page_stats_entries) {
+    vpn_map_free(&page_stats_index);
+    free(page_stats_entries);
+  }
+  vpn_map_init(&page_stats_index, 1024);
+  page_stats_capacity = 1024;
+  page_stats_entries = malloc(page_stats_capacity * sizeof(page_stats_entry_t));
+  if (!page_stats_entries) {
+    panic("Out of memory allocating page statistics");
+  }
+  page_stats_count = 0;
+}
+
+static page_stats_entry_t* page_stats_lookup(va_t virtual_page_number) {
+  bool inserted;
+  uint32_t* index = vpn_map_insert(&page_stats_index, virtual_page_number,
+                                   (uint32_t)page_stats_count, &inserted);
+  if (!inserted) {
+    return &page_stats_entries[*index];
+  }
+
+  if (page_stats_count == page_stats_capacity) {
+    page_stats_capacity <<= 1;
+    page_stats_entries = realloc(
+        page_stats_entries, page_stats_capacity * sizeof(page_stats_entry_t));
+    if (!page_stats_entries) {
+      panic("Out of memory allocating page statistics");
+    }
+  }
+
+  page_stats_entry_t* entry = &page_stats_entries[page_stats_count++];
+  memset(entry, 0, sizeof(*entry));
+  entry->virtual_page_number = virtual_page_number;
+  return entry;
+}
+
+void page_stats_record_access(va_t virtual_page_number, op_t op) {
+  if (!page_stats_enabled) return;
+  page_stats_entry_t* entry = page_stats_lookup(virtual_page_number);
+  entry->accesses++;
+  if (op == OP_WRITE) {
+    entry->writes++;
+  }
+}
+
+void page_stats_record_tlb_miss(va_t virtual_page_number) {
+  if (!page_stats_enabled) return;
+  page_stats_lookup(virtual_page_number)->tlb_misses++;
+}
+
+void page_stats_record_fault(va_t virtual_page_number) {
+  if (!page_stats_enabled) return;
+  page_stats_lookup(virtual_page_number)->faults++;
+}
+
+void page_stats_record_eviction(va_t virtual_page_number) {
+  if (!page_stats_enabled) return;
+  page_stats_lookup(virtual_page_number)->evictions++;
+}
+
+void page_stats_record_swap_in(va_t virtual_page_number) {
+  if (!page_stats_enabled) return;
+  page_stats_lookup(virtual_page_number)->swap_ins++;
+}
+
+static uint64_t hotness_score(const page_stats_entry_t* entry) {
+  return entry->accesses;
+}
+
+static uint64_t thrashing_score(const page_stats_entry_t* entry) {
+  return entry->evictions + entry->swap_ins;
+}
+
+// Keeps the n best entries (by score) in top[], sorted from best to worst.
+// n is small, so a simple insertion into a sorted array is the cheapest way
+// to do a partial sort over all the touched pages.
+static uint64_t select_top(const page_stats_entry_t** top, uint64_t n,
+                           uint64_t (*score)(const page_stats_entry_t*)) {
+  uint64_t selected = 0;
+  for (uint64_t i = 0; i < page_stats_count; i++) {
+    const page_stats_entry_t* entry = &page_stats_entries[i];
+    uint64_t entry_score = score(entry);
+    if (entry_score == 0) continue;
+    if (selected == n && entry_score <= score(top[n - 1])) continue;
+
+    uint64_t pos = selected < n ? selected++ : n - 1;
+    while (pos > 0 && score(top[pos - 1]) < entry_score) {
+      top[pos] = top[pos - 1];
+      pos--;
+    }
+    top[pos] = entry;
+  }
+  return selected;
+}
+
+static void print_page_table_header() {
+  log("  %-10s %12s %10s %10s %8s %9s %8s", "VPN", "Accesses", "Writes",
+      "TLB misses", "Faults", "Evictions", "Swap-ins");
+}
+
+static void print_page_entry(const page_stats_entry_t* entry) {
+  log("  %-10" PRIx64 " %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64
+      " %9" PRIu64 " %8" PRIu64,
+      entry->virtual_page_number, entry->accesses, entry->writes,
+      entry->tlb_misses, entry->faults, entry->evictions, entry->swap_ins);
+}
+
+static void print_heatmap() {
+  page_stats_bin_t bins[PAGE_STATS_HEATMAP_BINS];
+  memset(bins, 0, sizeof(bins));
+
+  uint64_t pages_per_bin = TOTAL_PAGES / PAGE_STATS_HEATMAP_BINS;
+  if (pages_per_bin == 0) pages_per_bin = 1;
+
+  uint64_t max_accesses = 0;
+  for (uint64_t i = 0; i < page_stats_count; i++) {
+    const page_stats_entry_t* entry = &page_stats_entries[i];
+    uint64_t bin = (entry->virtual_page_number & PAGE_INDEX_MASK) /
+                   pages_per_bin;
+    if (bin >= PAGE_STATS_HEATMAP_BINS) bin = PAGE_STATS_HEATMAP_BINS - 1;
+    bins[bin].accesses += entry->accesses;
+    bins[bin].tlb_misses += entry->tlb_misses;
+    bins[bin].faults += entry->faults;
+    bins[bin].pages++;
+    if (bins[bin].accesses > max_accesses) max_accesses = bins[bin].accesses;
+  }
+
+  // Intensity ramp, from cold to hot.
+  static const char ramp[] = " .:-=+*#%@";
+  const uint64_t ramp_levels = sizeof(ramp) - 2;
+
+  log("Address space heatmap (%d bins of %" PRIu64 " KiB):",
+      PAGE_STATS_HEATMAP_BINS, (pages_per_bin * PAGE_SIZE_BYTES) >> 10);
+  log("  %-10s %8s %12s %10s %8s  %s", "Base VA", "Pages", "Accesses",
+      "TLB misses", "Faults", "Heat");
+  for (uint64_t bin = 0; bin < PAGE_STATS_HEATMAP_BINS; bin++) {
+    if (bins[bin].pages == 0) continue;
+
+    char bar[PAGE_STATS_HEATMAP_WIDTH + 1];
+    uint64_t width = max_accesses
+                         ? (bins[bin].accesses * PAGE_STATS_HEATMAP_WIDTH +
+                            max_accesses - 1) / max_accesses
+                         : 0;
+    uint64_t level = max_accesses
+                         ? (bins[bin].accesses * ramp_levels + max_accesses -
+                            1) / max_accesses
+                         : 0;
+    memset(bar, ramp[level], width);
+    bar[width] = '\0';
+
+    log("  %-10" PRIx64 " %8" PRIu64 " %12" PRIu64 " %10" PRIu64 " %8" PRIu64
+        "  %s",
+        (bin * pages_per_bin) << PAGE_SIZE_BITS, bins[bin].pages,
+        bins[bin].accesses, bins[bin].tlb_misses, bins[bin].faults, bar);
+  }
+}
+
+void page_stats_report() {
+  if (!page_stats_enabled) return;
+
+  const page_stats_entry_t** top =
+      malloc(page_stats_top_n * sizeof(page_stats_entry_t*));
+  if (!top) {
+    panic("Out of memory building page statistics report");
+  }
+
+  log("=========== Page Statistics ===========");
+  log("Distinct pages touched: %" PRIu64, page_stats_count);
+
+  uint64_t selected = select_top(top, page_stats_top_n, hotness_score);
+  log("Top %" PRIu64 " hottest pages (by accesses):", selected);
+  print_page_table_header();
+  for (uint64_t i = 0; i < selected; i++) {
+    print_page_entry(top[i]);
+  }
+
+  selected = select_top(top, page_stats_top_n, thrashing_score);
+  log("Top %" PRIu64 " most thrashed pages (by evictions + swap-ins):",
+      selected);
+  print_page_table_header();
+  for (uint64_t i = 0; i < selected; i++) {
+    print_page_entry(top[i]);
+  }
+
+  print_heatmap();
+  log("=======================================");
+
+  free(top);
+}
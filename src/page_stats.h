@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Per-page access statistics.
+// When enabled, every event that touches a virtual page is counted against
+// that page so the final report can show which pages cause the faults and TLB
+// misses (hot pages), which ones keep bouncing between DRAM and disk (thrashed
+// pages), and how the accesses are spread over the virtual address space.
+
+void page_stats_enable(uint64_t top_n);
+bool page_stats_is_enabled();
+void page_stats_reset();
+
+void page_stats_record_access(va_t virtual_page_number, op_t op);
+void page_stats_record_tlb_miss(va_t virtual_page_number);
+void page_stats_record_fault(va_t virtual_page_number);
+void page_stats_record_eviction(va_t virtual_page_number);
+void page_stats_record_swap_in(va_t virtual_page_number);
+
+void page_stats_report();
@@ -6,10 +6,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "access_stream.h"
+#include "cache.h"
 #include "clock.h"
 #include "constants.h"
 #include "log.h"
+#include "nested.h"
+#include "numa.h"
+#include "page_stats.h"
+#include "profile.h"
+#include "pwc.h"
+#include "region.h"
+#include "stats.h"
+#include "timeline.h"
+#include "thp.h"
+#include "tier.h"
 #include "tlb.h"
+#include "wcb.h"
+#include "zswap.h"
 
 #define PAGE_TABLE_DRAM_ADDRESS (0)
 
@@ -19,6 +33,38 @@ pa_dram_t RANDOM_PAGE_ADDRESS_IT = 0;
 uint64_t page_faults = 0;
 uint64_t page_evictions = 0;
 
+// Breakdown of the events above, and of the page table's own DRAM traffic.
+uint64_t major_page_faults = 0;
+uint64_t minor_page_faults = 0;
+uint64_t clean_page_evictions = 0;
+uint64_t dirty_page_evictions = 0;
+uint64_t page_table_reads = 0;
+uint64_t page_table_writes = 0;
+uint64_t tlb_write_backs = 0;
+uint64_t dirty_bit_updates = 0;
+
+// Address-space management (munmap/mmap/fork/context switch records).
+uint64_t context_switches = 0;
+uint64_t forks = 0;
+uint64_t fork_shared_pages = 0;
+uint64_t cow_faults = 0;
+uint64_t cow_copies = 0;
+uint64_t cow_reuses = 0;
+uint64_t mapped_pages = 0;
+uint64_t populated_pages = 0;
+uint64_t freed_pages = 0;
+uint64_t released_swap_slots = 0;
+uint64_t zero_page_maps = 0;
+uint64_t zero_page_fills = 0;
+time_ns_t minor_fault_time = 0;
+time_ns_t major_fault_time = 0;
+uint64_t file_mapped_pages = 0;
+uint64_t file_page_ins = 0;
+uint64_t file_write_backs = 0;
+uint64_t file_page_drops = 0;
+uint64_t page_walks = 0;
+uint64_t upper_level_reads = 0;
+
 typedef struct {
   // This only stored the page index, not the full address.
   // The full address is constructed by shifting this value left by
@@ -31,18 +77,191 @@ typedef struct {
 
   // Has this entry been modified since it was loaded into memory?
   bool dirty;
-} page_table_entry_t;
 
-page_table_entry_t page_table[TOTAL_PAGES];
+  // Write-protected because the frame is shared copy-on-write: the first
+  // write takes a COW fault that gives the page a private frame.
+  bool cow;
+
+  // Part of a huge mapping: set on all HUGE_PAGE_PAGES entries of an aligned
+  // region, whose frames are then contiguous and aligned too. Stands for the
+  // single PMD-level entry of real hardware.
+  bool huge;
+} page_table_entry_t;
 
 typedef struct {
   bool is_swapped;
+
+  // File-backed pages live in their file: disk_page_number is the page's
+  // block in the file, which is where it is read from on a fault and written
+  // back to when evicted dirty. They never go to swap. File mappings are
+  // shared: address spaces mapping the same block share its frame,
+  // writable, across fork.
+  bool file_backed;
+
+  // A swapped page held compressed in the zswap pool rather than on disk:
+  // disk_page_number is then its zswap entry.
+  bool in_zswap;
   pa_disk_t disk_page_number;
 } pte_metadata_t;
 
-pte_metadata_t pte_metadata[TOTAL_PAGES];
+// One page table (and its metadata) per address space. They are allocated
+// when an address space is first switched to or forked into; calloc keeps
+// untouched parts of the 2 x TOTAL_PAGES arrays from costing host memory.
+typedef struct {
+  page_table_entry_t* entries;
+  pte_metadata_t* metadata;
+} address_space_t;
+
+address_space_t address_spaces[MAX_ADDRESS_SPACES];
+asid_t current_asid = 0;
+
+// Tables of the current address space.
+page_table_entry_t* page_table = NULL;
+pte_metadata_t* pte_metadata = NULL;
+
+// Frame table: one entry per DRAM frame. A frame is free when its reference
+// count is zero; frames shared copy-on-write after a fork have one reference
+// per mapping.
+// Frames of the slow tier, when there is one, follow DRAM's.
+typedef struct {
+  uint32_t refcount;
+  // Page the frame holds (only tracked for slow-tier frames).
+  va_t virtual_page_number;
+} frame_t;
+
+frame_t frame_table[DRAM_PAGE_CAPACITY + TIER_MAX_PAGES];
+
+// Next slow-tier frame to try, and the tier frame being promoted (which must
+// not be spilled while making room for it in DRAM).
+static uint64_t tier_next_frame = 0;
+static pa_dram_t promoting_frame = UINT64_MAX;
+
+// DRAM frames holding the zswap pool.
+static pa_dram_t* zswap_frames = NULL;
+static uint64_t zswap_frame_count = 0;
+
+// Shared zero page mode: first-touch reads of anonymous pages map zero_frame
+// copy-on-write instead of allocating. The frame is set up on first use and
+// holds a reference of its own, so it is never freed nor reused in place.
+static bool zero_page_enabled = false;
+static bool zero_frame_allocated = false;
+static pa_dram_t zero_frame;
+
+// Contiguity hint: a page faulted in next to a resident neighbour gets the
+// frame next to the neighbour's, if free, so that coalescing TLBs can cover
+// both with one entry.
+static bool contiguity_hint_enabled = false;
+
+// Exact evictions: an evicted page's own frame goes to the faulting page.
+// Without them eviction works as in the lab's reference simulator, which
+// hands out the victim's VPN as the new frame number: the victim's frame is
+// never freed and the new one may already be in use. Anything that shares,
+// moves or frees frames needs the frame table to be right, and turns them
+// on.
+static bool exact_evictions = false;
+
+// Hardware dirty bits: the MMU sets a PTE's dirty bit itself, with an atomic
+// write, the first time a write goes through a clean translation.
+static bool hardware_dirty_bits = false;
+
+// Levels of the radix table. The entries themselves stay in one flat array
+// per address space; upper levels only add the reads a walk makes.
+static uint32_t pt_levels = 1;
+
+// Where a page's entry at a level of the page table sits, as far as the CPU
+// caches are concerned: each address space's tables, a level at a time, in a
+// space of their own above physical memory. Neighbouring pages' entries
+// share cache lines, as they would in real tables.
+static uint64_t page_table_entry_address(asid_t asid,
+                                         va_t virtual_page_number,
+                                         uint32_t level) {
+  return (1llu << 63) | (uint64_t)asid << 40 | (uint64_t)level << 32 |
+         (virtual_page_number >> (PT_LEVEL_BITS * (level - 1))) *
+             PTE_SIZE_BYTES;
+}
+
+// Bytes of guest-physical memory one table level of an address space takes,
+// in whole frames (its upper levels hold at least one entry).
+static uint64_t page_table_level_bytes(uint32_t level) {
+  uint64_t entries = TOTAL_PAGES >> (PT_LEVEL_BITS * (level - 1));
+  uint64_t bytes = (entries ? entries : 1) * PTE_SIZE_BYTES;
+  return (bytes + PAGE_SIZE_BYTES - 1) & ~(PAGE_SIZE_BYTES - 1);
+}
+
+// Where a page's entry at a level sits in guest-physical memory, for the host
+// walks of nested paging: each address space's tables, a level at a time,
+// in frames of their own past DRAM and the slow tier, so that they never
+// share a frame (or a nested TLB entry) with data.
+static uint64_t page_table_entry_guest_address(asid_t asid,
+                                               va_t virtual_page_number,
+                                               uint32_t level) {
+  uint64_t space_bytes = 0;
+  uint64_t level_offset = 0;
+  for (uint32_t i = 1; i <= PT_MAX_LEVELS; i++) {
+    if (i == level) level_offset = space_bytes;
+    space_bytes += page_table_level_bytes(i);
+  }
+  return DRAM_SIZE_BYTES + TIER_MAX_PAGES * PAGE_SIZE_BYTES +
+         asid * space_bytes + level_offset +
+         (virtual_page_number >> (PT_LEVEL_BITS * (level - 1))) *
+             PTE_SIZE_BYTES;
+}
+
+// Level of the entry a translation ends at: a huge mapping's is a level 2
+// entry.
+static uint32_t leaf_level(const page_table_entry_t* entry) {
+  return entry->valid && entry->huge ? 2 : 1;
+}
+
+// All accesses to the page table itself go through here, so they can be told
+// apart from data transfers in the DRAM counters. A TLB write-back still
+// pending for the entry's line goes first, whoever reads or rewrites the
+// entry. Reads served by the CPU caches never reach DRAM; writes are written
+// through.
+static void page_table_access(op_t op, asid_t asid, va_t virtual_page_number,
+                              uint32_t level) {
+  uint64_t address = page_table_entry_address(asid, virtual_page_number, level);
+  wcb_flush_line(address / CACHE_LINE_SIZE_BYTES);
+  if (op == OP_WRITE) {
+    nested_record_page_table_write();
+  }
+  if (cache_access(address, op, CACHE_PAGE_TABLE) && op == OP_READ) {
+    return;
+  }
+  if (op == OP_WRITE) {
+    page_table_writes++;
+  } else {
+    page_table_reads++;
+  }
+  dram_access(PAGE_TABLE_DRAM_ADDRESS, op);
+}
+
+// A read of the current address space's page table by a walk. Under nested
+// paging the entry's guest-physical address is translated first.
+static void walk_read(va_t virtual_page_number, uint32_t level) {
+  nested_walk_read(page_table_entry_guest_address(
+      current_asid, virtual_page_number, level));
+  page_table_access(OP_READ, current_asid, virtual_page_number, level);
+}
 
-bool allocated_dram_pages[DRAM_PAGE_CAPACITY];
+// Reads the upper-level entries leading to a page's leaf entry, from the first
+// level the page-walk caches don't cover. A huge mapping's leaf is its level
+// 2 entry, so the walk reads no further than level 3 before it (the leaf
+// read is the caller's).
+static void walk_upper_levels(va_t virtual_page_number) {
+  page_walks++;
+  nested_walk_begin();
+  uint32_t lowest = page_table[virtual_page_number].valid &&
+                            page_table[virtual_page_number].huge
+                        ? 3
+                        : 2;
+  for (uint32_t level = pwc_lookup(virtual_page_number, lowest);
+       level >= lowest; level--) {
+    walk_read(virtual_page_number, level);
+    upper_level_reads++;
+    pwc_fill(virtual_page_number, level);
+  }
+}
 
 page_table_entry_t* get_free_page_table_entry() {
   for (va_t virtual_page_number = 0; virtual_page_number < TOTAL_PAGES;
@@ -54,17 +273,70 @@ page_table_entry_t* get_free_page_table_entry() {
   return NULL;
 }
 
-bool allocate_dram_page(pa_dram_t* dram_page_address) {
+// Takes the first free frame of one NUMA node's pool.
+static bool allocate_dram_page_on_node(uint32_t node,
+                                       pa_dram_t* dram_page_address) {
+  pa_dram_t first;
+  pa_dram_t end;
+  numa_node_frames(node, &first, &end);
   // Very inefficient (but simple) way of finding a free DRAM page.
-  for (pa_dram_t dram_page_number = 0; dram_page_number < DRAM_PAGE_CAPACITY;
+  for (pa_dram_t dram_page_number = first; dram_page_number < end;
        dram_page_number++) {
     if (dram_page_number == PAGE_TABLE_DRAM_ADDRESS) {
       continue;
     }
 
-    if (!allocated_dram_pages[dram_page_number]) {
-      allocated_dram_pages[dram_page_number] = true;
+    if (frame_table[dram_page_number].refcount == 0) {
+      frame_table[dram_page_number].refcount = 1;
       *dram_page_address = dram_page_number << PAGE_SIZE_BITS;
+      numa_record_allocation(dram_page_number);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Takes the frame right after (or before) the one holding a neighbouring page
+// of the current address space, if it is free and on the node.
+static bool allocate_contiguous_dram_page(va_t virtual_page_number,
+                                          uint32_t node,
+                                          pa_dram_t* dram_page_address) {
+  pa_dram_t first;
+  pa_dram_t end;
+  numa_node_frames(node, &first, &end);
+  for (int direction = 1; direction >= -1; direction -= 2) {
+    va_t neighbour = virtual_page_number - direction;
+    if (neighbour >= TOTAL_PAGES || !page_table[neighbour].valid) continue;
+    pa_dram_t frame = page_table[neighbour].dram_page_number + direction;
+    if (frame < first || frame >= end || frame == PAGE_TABLE_DRAM_ADDRESS ||
+        frame_table[frame].refcount != 0) {
+      continue;
+    }
+    frame_table[frame].refcount = 1;
+    *dram_page_address = frame << PAGE_SIZE_BITS;
+    numa_record_allocation(frame);
+    return true;
+  }
+  return false;
+}
+
+// Prefers the given node, then falls back to the others in order (there is
+// a single node, holding every frame, unless NUMA is enabled). With the
+// contiguity hint, a frame next to a neighbouring page's comes first.
+bool allocate_dram_page(pa_dram_t* dram_page_address,
+                        va_t virtual_page_number, uint32_t node) {
+  PROFILE_SCOPE(PROFILE_FRAME_ALLOCATOR);
+  if (contiguity_hint_enabled &&
+      allocate_contiguous_dram_page(virtual_page_number, node,
+                                    dram_page_address)) {
+    return true;
+  }
+  if (allocate_dram_page_on_node(node, dram_page_address)) {
+    return true;
+  }
+  for (uint32_t other = 0; other < numa_node_count(); other++) {
+    if (other != node &&
+        allocate_dram_page_on_node(other, dram_page_address)) {
       return true;
     }
   }
@@ -86,76 +358,626 @@ pa_disk_t allocate_disk_page() {
   return disk_page_address;
 }
 
-pa_dram_t randomly_evict_page_from_dram() {
+static address_space_t* address_space_create(asid_t asid) {
+  address_space_t* space = &address_spaces[asid];
+  if (!space->entries) {
+    space->entries = calloc(TOTAL_PAGES, sizeof(page_table_entry_t));
+    space->metadata = calloc(TOTAL_PAGES, sizeof(pte_metadata_t));
+    if (!space->entries || !space->metadata) {
+      panic("Out of memory allocating address space %" PRIu32, asid);
+    }
+  }
+  return space;
+}
+
+// Finds the first page resident in DRAM, looking at the current address
+// space first.
+static void find_eviction_victim(asid_t* victim_asid, va_t* victim_vpn) {
+  for (asid_t i = 0; i < MAX_ADDRESS_SPACES; i++) {
+    asid_t asid = (current_asid + i) % MAX_ADDRESS_SPACES;
+    page_table_entry_t* entries = address_spaces[asid].entries;
+    if (!entries) continue;
+    for (va_t vpn = 0; vpn < TOTAL_PAGES; vpn++) {
+      if (!entries[vpn].valid) continue;
+      pa_dram_t frame = entries[vpn].dram_page_number;
+      // Zero page mappings hold no memory of their own, and pages in the
+      // slow tier are already out of DRAM.
+      if (zero_frame_allocated && frame == zero_frame) continue;
+      if (tier_is_enabled() && frame >= DRAM_PAGE_CAPACITY) continue;
+      *victim_asid = asid;
+      *victim_vpn = vpn;
+      return;
+    }
+  }
+  panic("No resident page to evict");
+}
+
+// Turns the huge mapping holding a page back into HUGE_PAGE_PAGES ordinary
+// mappings of the same frames (one write, for the new last-level table), and
+// drops its TLB entry.
+static void split_huge_mapping(asid_t asid, va_t virtual_page_number,
+                               thp_split_cause_t cause) {
+  page_table_entry_t* entries = address_spaces[asid].entries;
+  if (!entries[virtual_page_number].huge) return;
+
+  if (asid == current_asid) {
+    tlb_invalidate(virtual_page_number);
+  }
+  va_t first = virtual_page_number & ~(HUGE_PAGE_PAGES - 1);
+  for (va_t vpn = first; vpn < first + HUGE_PAGE_PAGES; vpn++) {
+    entries[vpn].huge = false;
+  }
+  page_table_access(OP_WRITE, asid, virtual_page_number, 2);
+  thp_record_split(cause);
+  log_dbg("***** Split huge page at VPN %" PRIx64 " *****", first);
+}
+
+// Unmaps a frame from every address space sharing it, first writing it back
+// to its file or to swap if any sharer dirtied it, and leaves it free. Frames
+// are only shared by fork (copy-on-write, or file pages) and it keeps virtual
+// addresses, so the sharers are the same VPN in other address spaces.
+static void evict_frame_to_disk(va_t evicted_virtual_page_number,
+                                pa_dram_t frame) {
+  bool dirty = false;
+  uint32_t sharers = 0;
+  pte_metadata_t* victim_metadata = NULL;
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    page_table_entry_t* entries = address_spaces[asid].entries;
+    if (entries && entries[evicted_virtual_page_number].valid &&
+        entries[evicted_virtual_page_number].dram_page_number == frame) {
+      dirty |= entries[evicted_virtual_page_number].dirty;
+      sharers++;
+      victim_metadata =
+          &address_spaces[asid].metadata[evicted_virtual_page_number];
+    }
+  }
+  assert(victim_metadata && "Evicted frame not mapped");
+
+  bool file_backed = victim_metadata->file_backed;
+  pte_metadata_t swapped = {false, false, false, 0};
+  uint32_t zswap_entry;
+  if (file_backed && dirty) {
+    dirty_page_evictions++;
+    file_write_backs++;
+    log_dbg("***** Writing dirty file page %" PRIx64 " back to its file *****",
+            evicted_virtual_page_number);
+    disk_access(victim_metadata->disk_page_number << PAGE_SIZE_BITS, OP_WRITE);
+  } else if (file_backed) {
+    // Clean file pages are still intact in the file: dropping them is free.
+    clean_page_evictions++;
+    file_page_drops++;
+    log_dbg("***** Dropping clean file page %" PRIx64 " *****",
+            evicted_virtual_page_number);
+  } else if (dirty && zswap_is_enabled() &&
+             zswap_store(evicted_virtual_page_number, sharers,
+                         &zswap_entry)) {
+    dirty_page_evictions++;
+    log_dbg("***** Compressing dirty page %" PRIx64 " into zswap *****",
+            evicted_virtual_page_number);
+    swapped.is_swapped = true;
+    swapped.in_zswap = true;
+    swapped.disk_page_number = zswap_entry;
+  } else if (dirty) {
+    dirty_page_evictions++;
+    log_dbg("***** Evicting dirty page %" PRIx64 " to disk *****",
+            evicted_virtual_page_number);
+
+    pa_disk_t disk_page_address = allocate_disk_page();
+    swapped.is_swapped = true;
+    swapped.disk_page_number = disk_page_address >> PAGE_SIZE_BITS;
+
+    disk_access(disk_page_address, OP_WRITE);
+  } else {
+    clean_page_evictions++;
+    log_dbg("***** Evicting page %" PRIx64 " *****",
+            evicted_virtual_page_number);
+  }
+
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    address_space_t* space = &address_spaces[asid];
+    if (!space->entries) continue;
+    page_table_entry_t* evicted = &space->entries[evicted_virtual_page_number];
+    if (!evicted->valid || evicted->dram_page_number != frame) continue;
+
+    // The frame is about to be reused, so no stale translation may survive,
+    // whether the page was dirty or not. Only the current address space has
+    // entries in the TLB.
+    if (asid == current_asid) {
+      tlb_invalidate(evicted_virtual_page_number);
+    }
+    if (dirty && !file_backed) {
+      space->metadata[evicted_virtual_page_number] = swapped;
+    }
+    evicted->valid = false;
+    evicted->dirty = false;
+    evicted->cow = false;
+    frame_table[frame].refcount--;
+  }
+  assert(frame_table[frame].refcount == 0 && "Evicted frame still mapped");
+}
+
+// Points every mapping of a page at a new frame (after its contents were
+// copied there), moving the references along.
+static void remap_frame(va_t virtual_page_number, pa_dram_t old_frame,
+                        pa_dram_t new_frame) {
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    page_table_entry_t* entries = address_spaces[asid].entries;
+    if (!entries) continue;
+    page_table_entry_t* entry = &entries[virtual_page_number];
+    if (!entry->valid || entry->dram_page_number != old_frame) continue;
+    if (asid == current_asid) {
+      tlb_invalidate(virtual_page_number);
+    }
+    entry->dram_page_number = new_frame;
+    page_table_access(OP_WRITE, asid, virtual_page_number, 1);
+  }
+  frame_table[new_frame].refcount = frame_table[old_frame].refcount;
+  frame_table[new_frame].virtual_page_number = virtual_page_number;
+  frame_table[old_frame].refcount = 0;
+}
+
+// Takes the next free slow-tier frame, if any.
+static bool allocate_tier_frame(pa_dram_t* frame) {
+  for (uint64_t i = 0; i < tier_capacity(); i++) {
+    pa_dram_t candidate = DRAM_PAGE_CAPACITY + tier_next_frame;
+    tier_next_frame = (tier_next_frame + 1) % tier_capacity();
+    if (frame_table[candidate].refcount == 0) {
+      *frame = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Moves a DRAM page into the slow tier (spilling the tier's coldest page to
+// disk if it is full), leaving its DRAM frame free.
+static void demote_frame(va_t virtual_page_number, pa_dram_t frame) {
+  pa_dram_t tier_frame;
+  if (!allocate_tier_frame(&tier_frame)) {
+    tier_frame = tier_choose_victim(promoting_frame);
+    log_dbg("***** Spilling page %" PRIx64 " from the slow tier *****",
+            frame_table[tier_frame].virtual_page_number);
+    evict_frame_to_disk(frame_table[tier_frame].virtual_page_number,
+                        tier_frame);
+    tier_record_spill();
+  }
+  log_dbg("***** Demoting page %" PRIx64 " to the slow tier *****",
+          virtual_page_number);
+  dram_access(frame << PAGE_SIZE_BITS, OP_READ);
+  dram_access(tier_frame << PAGE_SIZE_BITS, OP_WRITE);
+  remap_frame(virtual_page_number, frame, tier_frame);
+  tier_record_demotion(tier_frame);
+}
+
+// Evicts a page from DRAM and hands its frame over to the caller (the frame
+// stays allocated, with a single reference). The page goes to the slow tier
+// if there is one, otherwise to disk.
+static pa_dram_t evict_one_page() {
+  time_ns_t start = get_time();
   page_evictions++;
 
-  va_t evicted_virtual_page_number = PAGE_TABLE_DRAM_ADDRESS;
-  while (!page_table[evicted_virtual_page_number].valid) {
-    evicted_virtual_page_number++;
+  asid_t evicted_asid;
+  va_t evicted_virtual_page_number;
+  find_eviction_victim(&evicted_asid, &evicted_virtual_page_number);
+  pa_dram_t frame =
+      address_spaces[evicted_asid]
+          .entries[evicted_virtual_page_number]
+          .dram_page_number;
+
+  // Huge pages are evicted a base page at a time, like Linux splitting them
+  // under reclaim.
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    page_table_entry_t* entries = address_spaces[asid].entries;
+    if (entries && entries[evicted_virtual_page_number].valid &&
+        entries[evicted_virtual_page_number].dram_page_number == frame) {
+      split_huge_mapping(asid, evicted_virtual_page_number,
+                         THP_SPLIT_EVICTION);
+    }
   }
 
-  if (page_table[evicted_virtual_page_number].dirty) {
+  page_stats_record_eviction(evicted_virtual_page_number);
+  region_record_eviction(evicted_virtual_page_number);
+  access_stream_set_eviction(evicted_virtual_page_number);
+
+  if (tier_is_enabled()) {
+    demote_frame(evicted_virtual_page_number, frame);
+  } else {
+    evict_frame_to_disk(evicted_virtual_page_number, frame);
+  }
+
+  page_table_access(OP_READ, evicted_asid, evicted_virtual_page_number, 1);
+  timeline_complete("eviction", start, "vpn", evicted_virtual_page_number);
+  return frame;
+}
+
+// The reference eviction (see exact_evictions): the victim's PTE is cleared,
+// but its frame stays allocated and its VPN's frame is freed and handed out
+// instead. Only dirty victims lose their TLB entries.
+static pa_dram_t evict_page_to_its_vpn() {
+  time_ns_t start = get_time();
+  page_evictions++;
+
+  asid_t evicted_asid;
+  va_t evicted_virtual_page_number;
+  find_eviction_victim(&evicted_asid, &evicted_virtual_page_number);
+  address_space_t* space = &address_spaces[evicted_asid];
+  page_table_entry_t* evicted = &space->entries[evicted_virtual_page_number];
+
+  page_stats_record_eviction(evicted_virtual_page_number);
+  region_record_eviction(evicted_virtual_page_number);
+  access_stream_set_eviction(evicted_virtual_page_number);
+
+  if (evicted->dirty) {
+    dirty_page_evictions++;
     log_dbg("***** Evicting dirty page %" PRIx64 " to disk *****",
             evicted_virtual_page_number);
 
     pa_disk_t disk_page_address = allocate_disk_page();
-    pte_metadata[evicted_virtual_page_number].is_swapped = true;
-    pte_metadata[evicted_virtual_page_number].disk_page_number =
+    space->metadata[evicted_virtual_page_number].is_swapped = true;
+    space->metadata[evicted_virtual_page_number].disk_page_number =
         disk_page_address >> PAGE_SIZE_BITS;
 
     disk_access(disk_page_address, OP_WRITE);
 
-    tlb_invalidate(evicted_virtual_page_number);
+    if (evicted_asid == current_asid) {
+      tlb_invalidate(evicted_virtual_page_number);
+    }
   } else {
+    clean_page_evictions++;
     log_dbg("***** Evicting page %" PRIx64 " *****",
             evicted_virtual_page_number);
   }
 
-  page_table[evicted_virtual_page_number].valid = false;
-  page_table[evicted_virtual_page_number].dirty = false;
+  evicted->valid = false;
+  evicted->dirty = false;
 
-  allocated_dram_pages[evicted_virtual_page_number] = false;
+  if (evicted_virtual_page_number < DRAM_PAGE_CAPACITY) {
+    frame_table[evicted_virtual_page_number].refcount = 0;
+  }
 
-  dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_READ);
+  page_table_access(OP_READ, evicted_asid, evicted_virtual_page_number, 1);
+  timeline_complete("eviction", start, "vpn", evicted_virtual_page_number);
 
   return evicted_virtual_page_number << PAGE_SIZE_BITS;
 }
 
-void page_fault_handler(va_t virtual_page_number) {
-  log_dbg("***** Page fault! *****");
-  page_faults++;
+// Hands frames the zswap pool no longer needs back to the allocator.
+static void zswap_shrink_pool() {
+  while (zswap_frame_count > zswap_pool_frames_needed()) {
+    frame_table[zswap_frames[--zswap_frame_count]].refcount = 0;
+  }
+}
 
+// Evicts a page from DRAM and hands its frame over to the caller. With exact
+// evictions the frame stays allocated, with a single reference, and while
+// the zswap pool is short of frames it takes the freed ones, and eviction
+// goes on.
+pa_dram_t randomly_evict_page_from_dram() {
+  PROFILE_SCOPE(PROFILE_PAGE_EVICTION);
+  if (!exact_evictions) {
+    return evict_page_to_its_vpn();
+  }
+  for (;;) {
+    pa_dram_t frame = evict_one_page();
+    frame_table[frame].refcount = 1;
+    zswap_shrink_pool();
+    if (zswap_frame_count < zswap_pool_frames_needed()) {
+      if (!zswap_frames) {
+        zswap_frames = malloc(DRAM_PAGE_CAPACITY * sizeof(pa_dram_t));
+        if (!zswap_frames) {
+          panic("Out of memory allocating the zswap pool");
+        }
+      }
+      zswap_frames[zswap_frame_count++] = frame;
+      continue;
+    }
+    return frame << PAGE_SIZE_BITS;
+  }
+}
+
+// The page the frame is for decides its NUMA placement.
+static pa_dram_t allocate_or_evict_dram_page(va_t virtual_page_number) {
   pa_dram_t page_dram_address;
-  if (!allocate_dram_page(&page_dram_address)) {
+  if (!allocate_dram_page(&page_dram_address, virtual_page_number,
+                          numa_placement_node(virtual_page_number))) {
     page_dram_address = randomly_evict_page_from_dram();
   }
+  return page_dram_address;
+}
 
+// Maps a never-written anonymous page to the shared zero frame, read-only.
+static void map_zero_page(va_t virtual_page_number) {
+  if (!zero_frame_allocated) {
+    zero_frame =
+        allocate_or_evict_dram_page(virtual_page_number) >> PAGE_SIZE_BITS;
+    zero_frame_allocated = true;
+  }
   page_table_entry_t* entry = &page_table[virtual_page_number];
-  entry->dram_page_number = page_dram_address >> PAGE_SIZE_BITS;
+  entry->dram_page_number = zero_frame;
   entry->valid = true;
   entry->dirty = false;
-  dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_WRITE);
+  entry->cow = true;
+  frame_table[zero_frame].refcount++;
+  zero_page_maps++;
+  page_table_access(OP_WRITE, current_asid, virtual_page_number, 1);
+}
+
+// Maps a file page another address space already holds in memory (at the
+// same VPN, since only fork shares file mappings) to the same frame.
+static bool map_resident_file_page(va_t virtual_page_number, op_t op) {
+  pa_disk_t block = pte_metadata[virtual_page_number].disk_page_number;
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    address_space_t* space = &address_spaces[asid];
+    if (asid == current_asid || !space->entries) continue;
+    page_table_entry_t* other = &space->entries[virtual_page_number];
+    pte_metadata_t* other_metadata = &space->metadata[virtual_page_number];
+    if (!other->valid || !other_metadata->file_backed ||
+        other_metadata->disk_page_number != block) {
+      continue;
+    }
+    page_table_entry_t* entry = &page_table[virtual_page_number];
+    entry->dram_page_number = other->dram_page_number;
+    entry->valid = true;
+    entry->dirty = op == OP_WRITE;
+    entry->cow = false;
+    frame_table[other->dram_page_number].refcount++;
+    page_table_access(OP_WRITE, current_asid, virtual_page_number, 1);
+    return true;
+  }
+  return false;
+}
+
+void page_fault_handler(va_t virtual_page_number, op_t op) {
+  log_dbg("***** Page fault! *****");
+  time_ns_t start = get_time();
+  page_faults++;
+  page_stats_record_fault(virtual_page_number);
+  access_stream_set_level(ACCESS_PAGE_FAULT);
 
+  pte_metadata_t* metadata = &pte_metadata[virtual_page_number];
+  if (zero_page_enabled && op == OP_READ && !metadata->is_swapped &&
+      !metadata->file_backed) {
+    map_zero_page(virtual_page_number);
+    minor_page_faults++;
+    region_record_fault(false);
+    minor_fault_time += get_time() - start;
+    timeline_complete("page_fault", start, "vpn", virtual_page_number);
+    return;
+  }
+  if (metadata->file_backed &&
+      map_resident_file_page(virtual_page_number, op)) {
+    minor_page_faults++;
+    region_record_fault(false);
+    minor_fault_time += get_time() - start;
+    timeline_complete("page_fault", start, "vpn", virtual_page_number);
+    return;
+  }
+
+  pa_dram_t page_dram_address =
+      allocate_or_evict_dram_page(virtual_page_number);
+
+  page_table_entry_t* entry = &page_table[virtual_page_number];
+  entry->dram_page_number = page_dram_address >> PAGE_SIZE_BITS;
+  entry->valid = true;
+  // A write fault installs the PTE already dirty, as the OS would: no
+  // separate dirty bit update follows.
+  entry->dirty = op == OP_WRITE;
+  entry->cow = false;
+  page_table_access(OP_WRITE, current_asid, virtual_page_number, 1);
+
+  bool major = metadata->is_swapped || metadata->file_backed;
   if (pte_metadata[virtual_page_number].is_swapped) {
     log_dbg("***** Page %" PRIx64 " is swapped, loading from disk *****",
             virtual_page_number);
+    if (metadata->in_zswap) {
+      zswap_load(metadata->disk_page_number);
+      zswap_shrink_pool();
+      metadata->in_zswap = false;
+    } else {
+      pa_disk_t disk_address = metadata->disk_page_number << PAGE_SIZE_BITS;
+      disk_access(disk_address, OP_READ);
+    }
+    dram_access(page_dram_address, OP_WRITE);
+    page_stats_record_swap_in(virtual_page_number);
+    pte_metadata[virtual_page_number].is_swapped = false;
+    major_page_faults++;
+    region_record_fault(true);
+    access_stream_set_major_fault();
+  } else if (pte_metadata[virtual_page_number].file_backed) {
+    log_dbg("***** Page %" PRIx64 " is file-backed, reading it from the file "
+            "*****", virtual_page_number);
     pa_disk_t disk_address = pte_metadata[virtual_page_number].disk_page_number
                              << PAGE_SIZE_BITS;
     disk_access(disk_address, OP_READ);
     dram_access(page_dram_address, OP_WRITE);
-    pte_metadata[virtual_page_number].is_swapped = false;
+    file_page_ins++;
+    major_page_faults++;
+    region_record_fault(true);
+    access_stream_set_major_fault();
+  } else {
+    minor_page_faults++;
+    region_record_fault(false);
+  }
+  if (major) {
+    major_fault_time += get_time() - start;
+  } else {
+    minor_fault_time += get_time() - start;
   }
+  timeline_complete("page_fault", start, "vpn", virtual_page_number);
+}
+
+// First write to a page shared copy-on-write. If other mappings still share
+// the frame the page gets a private copy (DRAM read + DRAM write); if this is
+// the last mapping it simply becomes writable again.
+static void cow_fault_handler(va_t virtual_page_number) {
+  log_dbg("***** Write to write-protected page! *****");
+  time_ns_t start = get_time();
+
+  page_table_entry_t* entry = &page_table[virtual_page_number];
+  pa_dram_t shared_frame = entry->dram_page_number;
+  if (zero_frame_allocated && shared_frame == zero_frame) {
+    // Leaving the zero page: a fresh frame, zero-filled, nothing to copy.
+    // This is where a never-written page finally costs memory, a minor
+    // fault on its own.
+    page_faults++;
+    minor_page_faults++;
+    zero_page_fills++;
+    region_record_fault(false);
+    pa_dram_t page_dram_address =
+      allocate_or_evict_dram_page(virtual_page_number);
+    frame_table[zero_frame].refcount--;
+    entry->dram_page_number = page_dram_address >> PAGE_SIZE_BITS;
+    entry->cow = false;
+    entry->dirty = true;
+    page_table_access(OP_WRITE, current_asid, virtual_page_number, 1);
+    minor_fault_time += get_time() - start;
+    timeline_complete("zero_fill", start, "vpn", virtual_page_number);
+    return;
+  }
+  cow_faults++;
+  // The other sharers keep their huge mapping; this one gets a page of its
+  // own.
+  split_huge_mapping(current_asid, virtual_page_number, THP_SPLIT_COW);
+  if (frame_table[shared_frame].refcount > 1) {
+    pa_dram_t page_dram_address =
+      allocate_or_evict_dram_page(virtual_page_number);
+    if (!entry->valid) {
+      // Making room evicted the shared page itself from every sharer, so
+      // there is nothing left to copy: fault it back in as a private page.
+      frame_table[page_dram_address >> PAGE_SIZE_BITS].refcount = 0;
+      page_fault_handler(virtual_page_number, OP_WRITE);
+      return;
+    }
+    // Or demoted it to the slow tier, still shared.
+    shared_frame = entry->dram_page_number;
+    dram_access(shared_frame << PAGE_SIZE_BITS, OP_READ);
+    dram_access(page_dram_address, OP_WRITE);
+    frame_table[shared_frame].refcount--;
+    entry->dram_page_number = page_dram_address >> PAGE_SIZE_BITS;
+    cow_copies++;
+  } else {
+    cow_reuses++;
+  }
+  entry->cow = false;
+  entry->dirty = true;
+  page_table_access(OP_WRITE, current_asid, virtual_page_number, 1);
+  timeline_complete("cow_fault", start, "vpn", virtual_page_number);
 }
 
 void page_table_init() {
-  memset(page_table, 0, sizeof(page_table));
-  memset(pte_metadata, 0, sizeof(pte_metadata));
-  memset(allocated_dram_pages, 0, sizeof(allocated_dram_pages));
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    free(address_spaces[asid].entries);
+    free(address_spaces[asid].metadata);
+    address_spaces[asid].entries = NULL;
+    address_spaces[asid].metadata = NULL;
+  }
+  current_asid = 0;
+  address_space_t* space = address_space_create(current_asid);
+  page_table = space->entries;
+  pte_metadata = space->metadata;
+  memset(frame_table, 0, sizeof(frame_table));
+  tier_next_frame = 0;
+  promoting_frame = UINT64_MAX;
+  zswap_frame_count = 0;
+  zero_page_enabled = false;
+  zero_frame_allocated = false;
+  contiguity_hint_enabled = false;
+  hardware_dirty_bits = false;
+  pt_levels = 1;
   page_faults = 0;
   page_evictions = 0;
+  major_page_faults = 0;
+  minor_page_faults = 0;
+  clean_page_evictions = 0;
+  dirty_page_evictions = 0;
+  page_table_reads = 0;
+  page_table_writes = 0;
+  tlb_write_backs = 0;
+  dirty_bit_updates = 0;
+  context_switches = 0;
+  forks = 0;
+  fork_shared_pages = 0;
+  cow_faults = 0;
+  cow_copies = 0;
+  cow_reuses = 0;
+  mapped_pages = 0;
+  populated_pages = 0;
+  freed_pages = 0;
+  released_swap_slots = 0;
+  zero_page_maps = 0;
+  zero_page_fills = 0;
+  minor_fault_time = 0;
+  major_fault_time = 0;
+  file_mapped_pages = 0;
+  file_page_ins = 0;
+  file_write_backs = 0;
+  file_page_drops = 0;
+  page_walks = 0;
+  upper_level_reads = 0;
+
+  stats_register_config("page_table.page_size_bits", PAGE_SIZE_BITS);
+  stats_register_config("page_table.total_pages", TOTAL_PAGES);
+  stats_register_config("page_table.dram_page_capacity", DRAM_PAGE_CAPACITY);
+  stats_register_counter("page_table.faults", &page_faults);
+  stats_register_counter("page_table.evictions", &page_evictions);
+  stats_register_counter("page_table.major_faults", &major_page_faults);
+  stats_register_counter("page_table.minor_faults", &minor_page_faults);
+  stats_register_counter("page_table.clean_evictions", &clean_page_evictions);
+  stats_register_counter("page_table.dirty_evictions", &dirty_page_evictions);
+  stats_register_counter("page_table.dram_reads", &page_table_reads);
+  stats_register_counter("page_table.dram_writes", &page_table_writes);
+  stats_register_counter("page_table.tlb_write_backs", &tlb_write_backs);
+  stats_register_counter("page_table.context_switches", &context_switches);
+  stats_register_counter("page_table.forks", &forks);
+  stats_register_counter("page_table.fork_shared_pages", &fork_shared_pages);
+  stats_register_counter("page_table.cow_faults", &cow_faults);
+  stats_register_counter("page_table.cow_copies", &cow_copies);
+  stats_register_counter("page_table.cow_reuses", &cow_reuses);
+  stats_register_counter("page_table.mapped_pages", &mapped_pages);
+  stats_register_counter("page_table.populated_pages", &populated_pages);
+  stats_register_counter("page_table.freed_pages", &freed_pages);
+  stats_register_counter("page_table.released_swap_slots",
+                         &released_swap_slots);
+  stats_register_counter("page_table.zero_page_maps", &zero_page_maps);
+  stats_register_counter("page_table.zero_page_fills", &zero_page_fills);
+  stats_register_counter("page_table.minor_fault_ns", &minor_fault_time);
+  stats_register_counter("page_table.major_fault_ns", &major_fault_time);
+  stats_register_counter("page_table.file_mapped_pages", &file_mapped_pages);
+  stats_register_counter("page_table.file_page_ins", &file_page_ins);
+  stats_register_counter("page_table.file_write_backs", &file_write_backs);
+  stats_register_counter("page_table.file_page_drops", &file_page_drops);
+}
+
+void page_table_enable_exact_evictions() {
+  exact_evictions = true;
+  stats_register_config("page_table.exact_evictions", exact_evictions);
+}
+
+void page_table_enable_zero_page() { zero_page_enabled = true; }
+
+void page_table_enable_contiguity_hint() { contiguity_hint_enabled = true; }
+
+void page_table_enable_hardware_dirty_bits() {
+  hardware_dirty_bits = true;
+  stats_register_counter("page_table.dirty_bit_updates", &dirty_bit_updates);
 }
 
+void page_table_set_levels(uint32_t levels) {
+  uint32_t max_levels = (PT_INDEX_BITS + PT_LEVEL_BITS - 1) / PT_LEVEL_BITS;
+  if (levels < 1 || levels > max_levels || levels > PT_MAX_LEVELS) {
+    panic("--pt-levels: a %d-bit page number fits in 1 to %" PRIu32 " levels",
+          PT_INDEX_BITS, max_levels);
+  }
+  pt_levels = levels;
+  stats_register_config("page_table.levels", levels);
+  stats_register_counter("page_table.walks", &page_walks);
+  stats_register_counter("page_table.upper_level_reads", &upper_level_reads);
+}
+
+uint32_t page_table_levels() { return pt_levels; }
+
 pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
+  PROFILE_SCOPE(PROFILE_PAGE_TABLE_TRANSLATE);
   virtual_address &= VIRTUAL_ADDRESS_MASK;
 
   va_t virtual_page_number =
@@ -165,13 +987,22 @@ pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
   assert(virtual_page_offset < PAGE_SIZE_BYTES && "Page offset out of bounds");
 
   page_table_entry_t* entry = &page_table[virtual_page_number];
+  walk_upper_levels(virtual_page_number);
   if (!entry->valid) {
-    page_fault_handler(virtual_page_number);
+    page_fault_handler(virtual_page_number, op);
   } else {
-    dram_access(PAGE_TABLE_DRAM_ADDRESS, OP_READ);
+    walk_read(virtual_page_number, leaf_level(entry));
   }
 
-  if (op == OP_WRITE) {
+  if (op == OP_WRITE && entry->cow) {
+    cow_fault_handler(virtual_page_number);
+  }
+
+  // Faults have installed written pages dirty already, so with hardware
+  // dirty bits this only catches a clean, writable PTE hit without a fault.
+  if (op == OP_WRITE && hardware_dirty_bits && !entry->dirty) {
+    page_table_set_dirty(virtual_page_number);
+  } else if (op == OP_WRITE) {
     entry->dirty = true;
   }
 
@@ -180,12 +1011,492 @@ pa_dram_t page_table_translate(va_t virtual_address, op_t op) {
   log_dbg("PTE found (VA=%" PRIx64 " VPN=%" PRIx64 " PA=%" PRIx64 ")",
           virtual_address, virtual_page_number, translated_address);
 
+  nested_walk_end(translated_address);
   return translated_address;
 }
 
-void write_back_tlb_entry(va_t virtual_address) {
-  dram_access(virtual_address, OP_WRITE);
+bool page_table_lookup(va_t virtual_address, pa_dram_t* physical_address) {
+  virtual_address &= VIRTUAL_ADDRESS_MASK;
+  va_t virtual_page_number =
+      (virtual_address >> PAGE_SIZE_BITS) & PAGE_INDEX_MASK;
+
+  page_table_entry_t* entry = &page_table[virtual_page_number];
+  walk_upper_levels(virtual_page_number);
+  walk_read(virtual_page_number, leaf_level(entry));
+  if (!entry->valid) {
+    return false;
+  }
+  *physical_address = (entry->dram_page_number << PAGE_SIZE_BITS) |
+                      (virtual_address & PAGE_OFFSET_MASK);
+  nested_walk_end(*physical_address);
+  return true;
+}
+
+// Converts a byte range into the range of pages it touches.
+static void page_range(va_t virtual_address, uint64_t length, va_t* first_vpn,
+                       uint64_t* pages) {
+  virtual_address &= VIRTUAL_ADDRESS_MASK;
+  if (length > VIRTUAL_SIZE_BYTES - virtual_address) {
+    length = VIRTUAL_SIZE_BYTES - virtual_address;
+  }
+  *first_vpn = virtual_address >> PAGE_SIZE_BITS;
+  *pages = length == 0 ? 0
+                       : ((virtual_address + length - 1) >> PAGE_SIZE_BITS) -
+                             *first_vpn + 1;
+}
+
+// Drops a page's frame reference, swap slot or zswap entry and clears its
+// PTE, in any address space. Its TLB entry is the caller's business.
+static void release_page(asid_t asid, va_t virtual_page_number) {
+  page_table_entry_t* entry =
+      &address_spaces[asid].entries[virtual_page_number];
+  pte_metadata_t* metadata =
+      &address_spaces[asid].metadata[virtual_page_number];
+  if (!entry->valid && !metadata->is_swapped && !metadata->file_backed) {
+    return;
+  }
+
+  if (entry->valid) {
+    frame_table[entry->dram_page_number].refcount--;
+    if (frame_table[entry->dram_page_number].refcount == 0) {
+      freed_pages++;
+    }
+  }
+  if (metadata->is_swapped) {
+    released_swap_slots++;
+  }
+  if (metadata->in_zswap) {
+    zswap_release(metadata->disk_page_number);
+    zswap_shrink_pool();
+  }
+  memset(entry, 0, sizeof(*entry));
+  memset(metadata, 0, sizeof(*metadata));
+  page_table_access(OP_WRITE, asid, virtual_page_number, 1);
+}
+
+void page_table_unmap(va_t virtual_address, uint64_t length) {
+  va_t first_vpn;
+  uint64_t pages;
+  page_range(virtual_address, length, &first_vpn, &pages);
+  if (pages == 0) return;
+  assert(exact_evictions && "Unmapping without exact evictions");
+
+  // A huge mapping sticking out of either end of the range is split first.
+  va_t end_vpn = first_vpn + pages;
+  va_t edges[2] = {first_vpn, end_vpn - 1};
+  for (int i = 0; i < 2; i++) {
+    va_t region = edges[i] & ~(HUGE_PAGE_PAGES - 1);
+    if (page_table[edges[i]].huge &&
+        (region < first_vpn || region + HUGE_PAGE_PAGES > end_vpn)) {
+      split_huge_mapping(current_asid, edges[i], THP_SPLIT_UNMAP);
+    }
+  }
+
+  // Translations for the range are dropped without writing back dirty bits:
+  // the PTEs are being cleared anyway.
+  tlb_invalidate_range(first_vpn, pages);
+
+  for (va_t vpn = first_vpn; vpn < first_vpn + pages; vpn++) {
+    release_page(current_asid, vpn);
+  }
+  log_dbg("***** Unmapped %" PRIu64 " pages at VPN %" PRIx64 " *****", pages,
+          first_vpn);
+}
+
+void page_table_map(va_t virtual_address, uint64_t length, uint32_t flags) {
+  va_t first_vpn;
+  uint64_t pages;
+  page_range(virtual_address, length, &first_vpn, &pages);
+  if (pages == 0) return;
+
+  // Like MAP_FIXED: whatever was mapped in the range before is discarded.
+  page_table_unmap(virtual_address, length);
+  mapped_pages += pages;
+
+  if (flags & MAP_FLAG_FILE) {
+    // The file gets a fresh extent on disk, one block per page.
+    for (va_t vpn = first_vpn; vpn < first_vpn + pages; vpn++) {
+      pte_metadata[vpn].file_backed = true;
+      pte_metadata[vpn].disk_page_number =
+          allocate_disk_page() >> PAGE_SIZE_BITS;
+    }
+    file_mapped_pages += pages;
+  }
+
+  if (flags & MAP_FLAG_POPULATE) {
+    for (va_t vpn = first_vpn; vpn < first_vpn + pages; vpn++) {
+      if (!page_table[vpn].valid) {
+        // Populating allocates real frames, even with the zero page, but
+        // nothing has written them yet.
+        page_fault_handler(vpn, OP_WRITE);
+        page_table[vpn].dirty = false;
+        populated_pages++;
+      }
+    }
+  }
+  log_dbg("***** Mapped %" PRIu64 " pages at VPN %" PRIx64 " *****", pages,
+          first_vpn);
+}
+
+void page_table_switch(asid_t asid) {
+  if (asid >= MAX_ADDRESS_SPACES) {
+    panic("Address space %" PRIu32 " out of range (max %d)", asid,
+          MAX_ADDRESS_SPACES - 1);
+  }
+  if (asid == current_asid) return;
+
+  // TLB entries are not tagged with an address space, so a switch flushes.
+  tlb_flush();
+  pwc_flush();
+
+  address_space_t* space = address_space_create(asid);
+  current_asid = asid;
+  page_table = space->entries;
+  pte_metadata = space->metadata;
+  context_switches++;
+  nested_record_switch();
+  log_dbg("***** Switched to address space %" PRIu32 " *****", asid);
+}
+
+void page_table_fork(asid_t child_asid) {
+  if (child_asid >= MAX_ADDRESS_SPACES) {
+    panic("Address space %" PRIu32 " out of range (max %d)", child_asid,
+          MAX_ADDRESS_SPACES - 1);
+  }
+  if (child_asid == current_asid) {
+    panic("Cannot fork address space %" PRIu32 " into itself", child_asid);
+  }
+  assert(exact_evictions && "Forking without exact evictions");
+  forks++;
+
+  address_space_t* child = &address_spaces[child_asid];
+  if (child->entries) {
+    // Drop the previous contents of the child (and their frame references).
+    // It isn't running, so it has nothing in the TLB.
+    for (va_t vpn = 0; vpn < TOTAL_PAGES; vpn++) {
+      release_page(child_asid, vpn);
+    }
+  }
+  child = address_space_create(child_asid);
+
+  // The parent loses write access to every anonymous page it shares, so
+  // cached writable translations must go (dirty ones are written back first).
+  tlb_flush();
+
+  // Child and parent share every resident anonymous frame read-only, and
+  // swapped-out pages share the swap slot, whose contents never change once
+  // written. File mappings are shared mappings: resident file frames stay
+  // writable in both, and their other pages fault in from the same blocks.
+  for (va_t vpn = 0; vpn < TOTAL_PAGES; vpn++) {
+    if (pte_metadata[vpn].is_swapped || pte_metadata[vpn].file_backed) {
+      child->metadata[vpn] = pte_metadata[vpn];
+    }
+    if (pte_metadata[vpn].in_zswap) {
+      zswap_share(pte_metadata[vpn].disk_page_number);
+    }
+    page_table_entry_t* parent_entry = &page_table[vpn];
+    if (!parent_entry->valid) continue;
+
+    if (!parent_entry->cow && !pte_metadata[vpn].file_backed) {
+      parent_entry->cow = true;
+      page_table_access(OP_WRITE, current_asid, vpn, 1);
+    }
+    child->entries[vpn] = *parent_entry;
+    page_table_access(OP_WRITE, child_asid, vpn, 1);
+    frame_table[parent_entry->dram_page_number].refcount++;
+    fork_shared_pages++;
+  }
+  log_dbg("***** Forked address space %" PRIu32 " into %" PRIu32 " *****",
+          current_asid, child_asid);
+}
+
+bool page_table_writable(va_t virtual_page_number) {
+  page_table_entry_t* entry = &page_table[virtual_page_number & PAGE_INDEX_MASK];
+  return entry->valid && !entry->cow;
+}
+
+bool page_table_migrate(va_t virtual_page_number, uint32_t node) {
+  page_table_entry_t* entry = &page_table[virtual_page_number & PAGE_INDEX_MASK];
+  // Shared frames (copy-on-write, zero page) stay where they are, and so do
+  // huge pages.
+  if (!entry->valid || entry->cow || entry->huge ||
+      entry->dram_page_number >= DRAM_PAGE_CAPACITY ||
+      frame_table[entry->dram_page_number].refcount != 1) {
+    return false;
+  }
+  // Migration never evicts: without a free frame on the node, the page stays.
+  pa_dram_t new_page_address;
+  if (!allocate_dram_page_on_node(node, &new_page_address)) {
+    return false;
+  }
+
+  time_ns_t start = get_time();
+  pa_dram_t old_frame = entry->dram_page_number;
+  dram_access(old_frame << PAGE_SIZE_BITS, OP_READ);
+  dram_access(new_page_address, OP_WRITE);
+  frame_table[old_frame].refcount = 0;
+  entry->dram_page_number = new_page_address >> PAGE_SIZE_BITS;
+  page_table_access(OP_WRITE, current_asid, virtual_page_number, 1);
+  tlb_invalidate(virtual_page_number);
+  timeline_complete("numa_migration", start, "vpn", virtual_page_number);
+  log_dbg("***** Migrated page %" PRIx64 " to node %" PRIu32 " *****",
+          virtual_page_number, node);
+  return true;
+}
+
+void page_table_zswap_write_back(va_t virtual_page_number, uint32_t entry) {
+  pa_disk_t disk_page_address = allocate_disk_page();
+  disk_access(disk_page_address, OP_WRITE);
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    pte_metadata_t* metadata = address_spaces[asid].metadata;
+    if (!metadata) continue;
+    pte_metadata_t* swapped = &metadata[virtual_page_number];
+    if (swapped->in_zswap && swapped->disk_page_number == entry) {
+      swapped->in_zswap = false;
+      swapped->disk_page_number = disk_page_address >> PAGE_SIZE_BITS;
+    }
+  }
+}
+
+bool page_table_promote(va_t virtual_page_number) {
+  page_table_entry_t* entry = &page_table[virtual_page_number & PAGE_INDEX_MASK];
+  if (!entry->valid || entry->dram_page_number < DRAM_PAGE_CAPACITY) {
+    return false;
+  }
+  pa_dram_t tier_frame = entry->dram_page_number;
+
+  // Making room in DRAM may demote another page, which may spill a tier page
+  // to disk: never this one.
+  promoting_frame = tier_frame;
+  pa_dram_t page_dram_address =
+      allocate_or_evict_dram_page(virtual_page_number);
+  promoting_frame = UINT64_MAX;
+
+  log_dbg("***** Promoting page %" PRIx64 " to DRAM *****",
+          virtual_page_number);
+  pa_dram_t frame = page_dram_address >> PAGE_SIZE_BITS;
+  dram_access(tier_frame << PAGE_SIZE_BITS, OP_READ);
+  dram_access(page_dram_address, OP_WRITE);
+  remap_frame(virtual_page_number, tier_frame, frame);
+  return true;
+}
+
+void page_table_reserve_frames(pa_dram_t first_frame, uint64_t frames) {
+  pa_dram_t end_frame = first_frame + frames;
+  if (zero_frame_allocated && zero_frame - first_frame < frames) {
+    panic("Frames %" PRIx64 "-%" PRIx64 " hold the shared zero page",
+          first_frame, end_frame - 1);
+  }
+  for (uint64_t i = 0; i < zswap_frame_count; i++) {
+    if (zswap_frames[i] - first_frame < frames) {
+      panic("Frames %" PRIx64 "-%" PRIx64 " hold the zswap pool", first_frame,
+            end_frame - 1);
+    }
+  }
+
+  // Evict whatever occupies the frames, as if they were reclaimed.
+  for (asid_t asid = 0; asid < MAX_ADDRESS_SPACES; asid++) {
+    page_table_entry_t* entries = address_spaces[asid].entries;
+    if (!entries) continue;
+    for (va_t vpn = 0; vpn < TOTAL_PAGES; vpn++) {
+      if (!entries[vpn].valid ||
+          entries[vpn].dram_page_number - first_frame >= frames) {
+        continue;
+      }
+      pa_dram_t frame = entries[vpn].dram_page_number;
+      for (asid_t sharer = 0; sharer < MAX_ADDRESS_SPACES; sharer++) {
+        page_table_entry_t* shared = address_spaces[sharer].entries;
+        if (shared && shared[vpn].valid &&
+            shared[vpn].dram_page_number == frame) {
+          split_huge_mapping(sharer, vpn, THP_SPLIT_EVICTION);
+        }
+      }
+      page_evictions++;
+      if (tier_is_enabled()) {
+        demote_frame(vpn, frame);
+      } else {
+        evict_frame_to_disk(vpn, frame);
+      }
+    }
+  }
+
+  for (pa_dram_t frame = first_frame; frame < end_frame; frame++) {
+    if (frame_table[frame].refcount != 0) {
+      panic("Frame %" PRIx64 " is already reserved", frame);
+    }
+    frame_table[frame].refcount = 1;
+  }
+}
+
+// Finds a free, aligned run of HUGE_PAGE_PAGES frames on a NUMA node. The
+// first run holds the page table, so it never qualifies.
+static bool find_free_huge_frame_on_node(uint32_t node, pa_dram_t* first_frame) {
+  pa_dram_t first;
+  pa_dram_t end;
+  numa_node_frames(node, &first, &end);
+  first = (first + HUGE_PAGE_PAGES - 1) & ~(HUGE_PAGE_PAGES - 1);
+  if (first == 0) {
+    first = HUGE_PAGE_PAGES;
+  }
+  for (pa_dram_t base = first; base + HUGE_PAGE_PAGES <= end;
+       base += HUGE_PAGE_PAGES) {
+    uint64_t i = 0;
+    while (i < HUGE_PAGE_PAGES && frame_table[base + i].refcount == 0) {
+      i++;
+    }
+    if (i == HUGE_PAGE_PAGES) {
+      *first_frame = base;
+      return true;
+    }
+  }
+  return false;
+}
+
+collapse_result_t page_table_collapse(va_t first_virtual_page_number) {
+  page_table_entry_t* entries = &page_table[first_virtual_page_number];
+  pte_metadata_t* metadata = &pte_metadata[first_virtual_page_number];
+  bool in_place = entries[0].dram_page_number % HUGE_PAGE_PAGES == 0;
+  bool dirty = false;
+  for (uint64_t i = 0; i < HUGE_PAGE_PAGES; i++) {
+    page_table_entry_t* entry = &entries[i];
+    if (!entry->valid || entry->huge || entry->cow ||
+        metadata[i].file_backed ||
+        entry->dram_page_number >= DRAM_PAGE_CAPACITY ||
+        frame_table[entry->dram_page_number].refcount != 1) {
+      return COLLAPSE_INELIGIBLE;
+    }
+    in_place &= entry->dram_page_number == entries[0].dram_page_number + i;
+    dirty |= entry->dirty;
+  }
+
+  pa_dram_t base = entries[0].dram_page_number;
+  if (!in_place) {
+    uint32_t node = numa_placement_node(first_virtual_page_number);
+    bool found = find_free_huge_frame_on_node(node, &base);
+    for (uint32_t other = 0; !found && other < numa_node_count(); other++) {
+      found = other != node && find_free_huge_frame_on_node(other, &base);
+    }
+    if (!found) return COLLAPSE_NO_FRAME;
+
+    for (uint64_t i = 0; i < HUGE_PAGE_PAGES; i++) {
+      pa_dram_t old_frame = entries[i].dram_page_number;
+      dram_access(old_frame << PAGE_SIZE_BITS, OP_READ);
+      dram_access((base + i) << PAGE_SIZE_BITS, OP_WRITE);
+      frame_table[old_frame].refcount = 0;
+      frame_table[base + i].refcount = 1;
+      numa_record_allocation(base + i);
+      entries[i].dram_page_number = base + i;
+    }
+  }
+  // One dirty bit for the whole huge page. Writes the TLB hasn't written back
+  // yet count too, since its entries are dropped without write-back.
+  dirty |= tlb_range_dirty(first_virtual_page_number, HUGE_PAGE_PAGES);
+  for (uint64_t i = 0; i < HUGE_PAGE_PAGES; i++) {
+    entries[i].huge = true;
+    entries[i].dirty = dirty;
+  }
+  page_table_access(OP_WRITE, current_asid, first_virtual_page_number, 2);
+  tlb_invalidate_range(first_virtual_page_number, HUGE_PAGE_PAGES);
+  log_dbg("***** Collapsed VPN %" PRIx64 " into huge frame %" PRIx64 " *****",
+          first_virtual_page_number, base);
+  return in_place ? COLLAPSE_IN_PLACE : COLLAPSE_COPIED;
+}
+
+uint64_t page_table_mapping_range(va_t virtual_page_number,
+                                  uint64_t coalesce_pages, va_t* first_vpn) {
+  virtual_page_number &= PAGE_INDEX_MASK;
+  page_table_entry_t* entry = &page_table[virtual_page_number];
+  if (entry->valid && entry->huge) {
+    *first_vpn = virtual_page_number & ~(HUGE_PAGE_PAGES - 1);
+    return HUGE_PAGE_PAGES;
+  }
+  *first_vpn = virtual_page_number;
+  if (!entry->valid || coalesce_pages <= 1) return 1;
+
+  // Neighbours within the aligned group (the PTEs the walk fetched along
+  // with this one) that map the adjacent frames with the same protection
+  // (and, when the TLB caches it, the same dirty bit).
+  va_t group = virtual_page_number & ~(coalesce_pages - 1);
+  va_t last = virtual_page_number;
+  while (*first_vpn > group) {
+    page_table_entry_t* neighbour = &page_table[*first_vpn - 1];
+    if (!neighbour->valid || neighbour->huge || neighbour->cow != entry->cow ||
+        (hardware_dirty_bits && neighbour->dirty != entry->dirty) ||
+        neighbour->dram_page_number !=
+            entry->dram_page_number - (virtual_page_number - *first_vpn + 1)) {
+      break;
+    }
+    (*first_vpn)--;
+  }
+  while (last + 1 < group + coalesce_pages) {
+    page_table_entry_t* neighbour = &page_table[last + 1];
+    if (!neighbour->valid || neighbour->huge || neighbour->cow != entry->cow ||
+        (hardware_dirty_bits && neighbour->dirty != entry->dirty) ||
+        neighbour->dram_page_number !=
+            entry->dram_page_number + (last + 1 - virtual_page_number)) {
+      break;
+    }
+    last++;
+  }
+  return last - *first_vpn + 1;
+}
+
+asid_t page_table_current_asid() { return current_asid; }
+
+void page_table_set_dirty(va_t virtual_page_number) {
+  virtual_page_number &= PAGE_INDEX_MASK;
+  page_table_entry_t* entry = &page_table[virtual_page_number];
+  // A huge page has a single dirty bit.
+  if (entry->huge) {
+    va_t first = virtual_page_number & ~(HUGE_PAGE_PAGES - 1);
+    for (va_t vpn = first; vpn < first + HUGE_PAGE_PAGES; vpn++) {
+      page_table[vpn].dirty = true;
+    }
+  }
+  entry->dirty = true;
+  dirty_bit_updates++;
+  page_table_access(OP_WRITE, current_asid, virtual_page_number,
+                    leaf_level(entry));
+}
+
+bool page_table_dirty(va_t virtual_page_number) {
+  page_table_entry_t* entry = &page_table[virtual_page_number & PAGE_INDEX_MASK];
+  return entry->valid && entry->dirty;
+}
+
+void write_back_tlb_entry(va_t virtual_page_number,
+                          pa_dram_t physical_address) {
+  tlb_write_backs++;
+  if (wcb_is_enabled()) {
+    virtual_page_number &= PAGE_INDEX_MASK;
+    uint64_t address = page_table_entry_address(
+        current_asid, virtual_page_number,
+        leaf_level(&page_table[virtual_page_number]));
+    wcb_write(address / CACHE_LINE_SIZE_BYTES, physical_address);
+    return;
+  }
+  dram_access(physical_address, OP_WRITE);
 }
 
 uint64_t get_total_page_faults() { return page_faults; }
-uint64_t get_total_page_evictions() { return page_evictions; }
\ No newline at end of file
+uint64_t get_total_page_evictions() { return page_evictions; }
+uint64_t get_total_major_page_faults() { return major_page_faults; }
+uint64_t get_total_minor_page_faults() { return minor_page_faults; }
+uint64_t get_total_clean_page_evictions() { return clean_page_evictions; }
+uint64_t get_total_dirty_page_evictions() { return dirty_page_evictions; }
+uint64_t get_total_page_table_reads() { return page_table_reads; }
+uint64_t get_total_page_table_writes() { return page_table_writes; }
+uint64_t get_total_tlb_write_backs() { return tlb_write_backs; }
+uint64_t get_total_dirty_bit_updates() { return dirty_bit_updates; }
+uint64_t get_total_cow_faults() { return cow_faults; }
+uint64_t get_total_cow_copies() { return cow_copies; }
+uint64_t get_total_cow_reuses() { return cow_reuses; }
+uint64_t get_total_zero_page_maps() { return zero_page_maps; }
+uint64_t get_total_zero_page_fills() { return zero_page_fills; }
+time_ns_t get_total_minor_fault_time() { return minor_fault_time; }
+time_ns_t get_total_major_fault_time() { return major_fault_time; }
+uint64_t get_total_file_page_ins() { return file_page_ins; }
+uint64_t get_total_file_write_backs() { return file_write_backs; }
+uint64_t get_total_file_page_drops() { return file_page_drops; }
+uint64_t get_total_page_walks() { return page_walks; }
+uint64_t get_total_upper_level_reads() { return upper_level_reads; }
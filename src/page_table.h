@@ -1,10 +1,162 @@
 #pragma once
 
+#include <stdbool.h>
+
+#include "clock.h"
 #include "memory.h"
 
+// Address space identifier, selects one of MAX_ADDRESS_SPACES page tables.
+typedef uint32_t asid_t;
+
+// page_table_map() flags.
+#define MAP_FLAG_POPULATE 0x1  // Fault every page in right away.
+#define MAP_FLAG_FILE 0x2      // Backed by a file instead of anonymous memory.
+
 void page_table_init();
+
+// Evicted pages give their own frame to the faulting page. By default the
+// victim's VPN is handed out as the frame number instead, as in the lab's
+// reference simulator, which leaks the victim's frame and can alias live
+// ones. Unmapping and forking need this on from the start of the run.
+void page_table_enable_exact_evictions();
+
+// Shared zero page: first-touch reads of anonymous pages map one read-only
+// zero frame and only the first write allocates (and zero-fills) a frame.
+void page_table_enable_zero_page();
+
+// Contiguity-preserving allocation: a page faulting in next to a resident
+// neighbour gets the frame adjacent to the neighbour's when it is free.
+void page_table_enable_contiguity_hint();
+
+// Radix page table of `levels` levels (1, the default, is a flat table):
+// walks read one entry per level, minus those the page-walk caches hold (see
+// pwc.h).
+void page_table_set_levels(uint32_t levels);
+uint32_t page_table_levels();
+
+// Hardware-managed dirty bits (see tlb_enable_hardware_dirty_bits): writes
+// through a clean translation set the PTE's dirty bit with
+// page_table_set_dirty, and coalesced TLB entries only span pages with the
+// same dirty bit.
+void page_table_enable_hardware_dirty_bits();
+
 pa_dram_t page_table_translate(va_t virtual_address, op_t op);
-void write_back_tlb_entry(va_t virtual_address);
+// Dirty state of a TLB entry for the page, mapped at physical_address, goes
+// back to its PTE: a DRAM write, or a pending one in the write-combining
+// buffer (see wcb.h).
+void write_back_tlb_entry(va_t virtual_page_number,
+                          pa_dram_t physical_address);
+
+// Atomic update of a resident page's dirty bit by the MMU: one page table
+// write.
+void page_table_set_dirty(va_t virtual_page_number);
+// Pure query, no timing.
+bool page_table_dirty(va_t virtual_page_number);
+
+// Walks the page table without faulting (one page-table read). Returns false
+// if the page is not resident.
+bool page_table_lookup(va_t virtual_address, pa_dram_t* physical_address);
+
+// munmap/free: releases the frames and swap slots of every page touching the
+// range, clears their PTEs and drops their TLB entries.
+void page_table_unmap(va_t virtual_address, uint64_t length);
+
+// mmap: replaces whatever was mapped in the range (like MAP_FIXED), and with
+// MAP_FLAG_POPULATE faults every page in immediately. MAP_FLAG_FILE maps a
+// new file: its pages fault in from the file, clean ones are dropped for free
+// on eviction and dirty ones are written back to the file, not to swap. Like
+// MAP_SHARED, a forked child shares the mapping: both sides use the same
+// frame for a block, and see each other's writes.
+void page_table_map(va_t virtual_address, uint64_t length, uint32_t flags);
+
+// Context switch. The TLB is flushed since its entries are not tagged.
+void page_table_switch(asid_t asid);
+
+// Forks the current address space into child_asid (replacing anything
+// there). Resident anonymous pages are shared copy-on-write: both sides lose
+// write access until their first write, which copies the frame if it is
+// still shared. File mappings stay shared (see page_table_map). The current
+// address space stays active.
+void page_table_fork(asid_t child_asid);
+
+// Whether a write to the (resident) page can go ahead without a COW fault.
+// Pure query, no timing.
+bool page_table_writable(va_t virtual_page_number);
+
+// Moves a private resident page of the current address space to a free
+// frame on the given NUMA node, charging the copy. Returns false if the page
+// is shared or the node has no free frame.
+bool page_table_migrate(va_t virtual_page_number, uint32_t node);
+
+// The zswap pool writes an entry back to disk: the pages swapped into it
+// now have a disk slot instead.
+void page_table_zswap_write_back(va_t virtual_page_number, uint32_t entry);
+
+// Moves a page of the current address space from the slow tier back to
+// DRAM, charging the copy. Returns false if it isn't in the tier.
+bool page_table_promote(va_t virtual_page_number);
+
+// khugepaged (see thp.h): tries to collapse the aligned region of
+// HUGE_PAGE_PAGES pages of the current address space starting at
+// first_virtual_page_number into one huge mapping, charging the copy.
+typedef enum {
+  COLLAPSE_INELIGIBLE,  // Not all resident, private and anonymous.
+  COLLAPSE_NO_FRAME,    // No free, aligned run of frames to copy into.
+  COLLAPSE_IN_PLACE,    // The frames already were one: no copy needed.
+  COLLAPSE_COPIED,
+} collapse_result_t;
+collapse_result_t page_table_collapse(va_t first_virtual_page_number);
+
+// The range of pages one TLB entry can cover for a (resident) page of the
+// current address space: the whole region of a huge mapping, otherwise the
+// run of neighbours mapped to contiguous frames with the same protection
+// within the page's aligned group of coalesce_pages (a power of two; 1
+// disables coalescing). Returns its length and sets *first_vpn. Pure query.
+uint64_t page_table_mapping_range(va_t virtual_page_number,
+                                  uint64_t coalesce_pages, va_t* first_vpn);
+
+// Takes frames [first_frame, first_frame + frames) away from paging for
+// good, evicting (or demoting) the pages they hold. Used by direct segments.
+void page_table_reserve_frames(pa_dram_t first_frame, uint64_t frames);
+
+asid_t page_table_current_asid();
 
 uint64_t get_total_page_faults();
 uint64_t get_total_page_evictions();
+
+// Major faults had to read the page back from disk, minor faults did not.
+uint64_t get_total_major_page_faults();
+uint64_t get_total_minor_page_faults();
+
+// Simulated time spent handling each fault class.
+time_ns_t get_total_minor_fault_time();
+time_ns_t get_total_major_fault_time();
+
+// Reads mapped to the shared zero page, and zero-page pages later written
+// (each of those is a minor fault of its own).
+uint64_t get_total_zero_page_maps();
+uint64_t get_total_zero_page_fills();
+uint64_t get_total_clean_page_evictions();
+uint64_t get_total_dirty_page_evictions();
+uint64_t get_total_page_table_reads();
+uint64_t get_total_page_table_writes();
+uint64_t get_total_tlb_write_backs();
+// Hardware dirty bit updates (page_table_set_dirty).
+uint64_t get_total_dirty_bit_updates();
+
+// COW faults either copied a still-shared frame or reused the last
+// reference in place.
+uint64_t get_total_cow_faults();
+uint64_t get_total_cow_copies();
+uint64_t get_total_cow_reuses();
+
+// File-backed pages read in on a fault, written back to their file when
+// evicted dirty, and dropped without I/O when evicted clean.
+uint64_t get_total_file_page_ins();
+uint64_t get_total_file_write_backs();
+uint64_t get_total_file_page_drops();
+
+// Page walks (TLB misses and prefetches), and the reads they made above the
+// PTEs.
+uint64_t get_total_page_walks();
+uint64_t get_total_upper_level_reads();
@@ -0,0 +1,64 @@
+#include "profile.h"
+
+#if SIM_PROFILE
+
+#include <stdlib.h>
+
+#include "log.h"
+
+typedef struct {
+  uint64_t calls;
+  uint64_t total;
+  uint64_t max;
+} profile_counter_t;
+
+static const char* profile_scope_names[PROFILE_SCOPE_COUNT] = {
+    [PROFILE_PARSE] = "parse",
+    [PROFILE_TLB_L1_FIND] = "l1_find",
+    [PROFILE_TLB_L2_FIND] = "l2_find",
+    [PROFILE_TLB_L1_VICTIM] = "l1_choose_victim",
+    [PROFILE_TLB_L2_VICTIM] = "l2_choose_victim",
+    [PROFILE_PAGE_TABLE_TRANSLATE] = "page_table_translate",
+    [PROFILE_PAGE_EVICTION] = "randomly_evict_page_from_dram",
+    [PROFILE_FRAME_ALLOCATOR] = "allocate_dram_page",
+    [PROFILE_LOGGING] = "logging",
+};
+
+profile_counter_t profile_counters[PROFILE_SCOPE_COUNT];
+uint64_t profile_start_time = 0;
+
+__attribute__((constructor)) static void profile_init() {
+  profile_start_time = profile_now();
+}
+
+void profile_scope_exit(profile_guard_t* guard) {
+  uint64_t elapsed = profile_now() - guard->start;
+  profile_counter_t* counter = &profile_counters[guard->scope];
+  counter->calls++;
+  counter->total += elapsed;
+  if (elapsed > counter->max) {
+    counter->max = elapsed;
+  }
+}
+
+void profile_report() {
+  uint64_t run_time = profile_now() - profile_start_time;
+
+  log_dbg("=========== Simulator Profile ===========");
+  log_dbg("Total run time: %" PRIu64 " %s", run_time, PROFILE_TIME_UNIT);
+  log_dbg("%-30s %12s %16s %10s %12s %7s", "Scope", "Calls",
+          "Total " PROFILE_TIME_UNIT, "Avg", "Max", "Run %");
+  for (int scope = 0; scope < PROFILE_SCOPE_COUNT; scope++) {
+    const profile_counter_t* counter = &profile_counters[scope];
+    if (counter->calls == 0) continue;
+    log_dbg("%-30s %12" PRIu64 " %16" PRIu64 " %10.1f %12" PRIu64 " %6.2f%%",
+            profile_scope_names[scope], counter->calls, counter->total,
+            (double)counter->total / counter->calls, counter->max,
+            run_time ? 100.0 * counter->total / run_time : 0.0);
+  }
+  log_dbg("(scopes are inclusive: nested scopes are also counted in their "
+          "parents)");
+  log_dbg("=========================================");
+}
+
+#endif
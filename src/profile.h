@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// Self-profiling of the simulator's hot paths (host time, not simulated time).
+// Build with -DSIM_PROFILE=1 (or flip the default in constants.h) to get a
+// table of calls and cycles per scope on stderr at exit. When disabled every
+// macro below expands to nothing, so the instrumented code is unchanged.
+//
+// Usage: put PROFILE_SCOPE(PROFILE_xxx); at the top of a block; the time
+// until the block is left (by any path, including early returns) is charged
+// to that scope. Scopes nest and are inclusive of their children.
+
+typedef enum {
+  PROFILE_PARSE,
+  PROFILE_TLB_L1_FIND,
+  PROFILE_TLB_L2_FIND,
+  PROFILE_TLB_L1_VICTIM,
+  PROFILE_TLB_L2_VICTIM,
+  PROFILE_PAGE_TABLE_TRANSLATE,
+  PROFILE_PAGE_EVICTION,
+  PROFILE_FRAME_ALLOCATOR,
+  PROFILE_LOGGING,
+  PROFILE_SCOPE_COUNT,
+} profile_scope_t;
+
+#if SIM_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_TIME_UNIT "cycles"
+static inline uint64_t profile_now() { return __rdtsc(); }
+#else
+#include <time.h>
+#define PROFILE_TIME_UNIT "ns"
+static inline uint64_t profile_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000llu + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+typedef struct {
+  profile_scope_t scope;
+  uint64_t start;
+} profile_guard_t;
+
+void profile_scope_exit(profile_guard_t* guard);
+void profile_report();
+
+#define PROFILE_SCOPE(scope)                                  \
+  profile_guard_t profile_guard                               \
+      __attribute__((cleanup(profile_scope_exit), unused)) = { \
+          (scope), profile_now()}
+#define PROFILE_REPORT() profile_report()
+
+#else
+
+#define PROFILE_SCOPE(scope) \
+  do {                       \
+  } while (0)
+#define PROFILE_REPORT() \
+  do {                   \
+  } while (0)
+
+#endif
@@ -0,0 +1,131 @@
+// sigaction() and clock_gettime() are POSIX, not ISO C.
+#define _POSIX_C_SOURCE 200809L
+
+#include "progress.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "clock.h"
+#include "log.h"
+#include "stats.h"
+
+// Host clock is only read every this many instructions, to keep the per
+// instruction cost down to a counter check.
+#define PROGRESS_POLL_MASK 4095
+
+volatile sig_atomic_t progress_snapshot_requested = 0;
+volatile sig_atomic_t progress_stop_requested = 0;
+
+FILE* progress_trace = NULL;
+uint64_t progress_trace_size = 0;
+uint64_t progress_interval_ns = 0;
+const char* progress_snapshot_path = NULL;
+uint64_t progress_start_ns = 0;
+uint64_t progress_next_report_ns = 0;
+uint64_t progress_snapshots = 0;
+
+static uint64_t host_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000llu + (uint64_t)ts.tv_nsec;
+}
+
+static void handle_sigusr1(int signal_number) {
+  (void)signal_number;
+  progress_snapshot_requested = 1;
+}
+
+static void handle_sigint(int signal_number) {
+  (void)signal_number;
+  progress_stop_requested = 1;
+}
+
+void progress_init(FILE* trace, uint64_t interval_seconds,
+                   const char* snapshot_path) {
+  progress_trace = trace;
+  progress_interval_ns = interval_seconds * 1000000000llu;
+  progress_snapshot_path = snapshot_path;
+  progress_start_ns = host_time_ns();
+  progress_next_report_ns = progress_start_ns + progress_interval_ns;
+  progress_snapshots = 0;
+
+  progress_trace_size = 0;
+  if (fseek(trace, 0, SEEK_END) == 0) {
+    long size = ftell(trace);
+    progress_trace_size = size > 0 ? (uint64_t)size : 0;
+  }
+  rewind(trace);
+
+  struct sigaction action;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  action.sa_handler = handle_sigusr1;
+  sigaction(SIGUSR1, &action, NULL);
+  // One-shot, so that a second Ctrl-C terminates right away.
+  action.sa_flags = SA_RESTART | SA_RESETHAND;
+  action.sa_handler = handle_sigint;
+  sigaction(SIGINT, &action, NULL);
+
+  stats_register_counter("sim.snapshots", &progress_snapshots);
+}
+
+static void write_snapshot() {
+  progress_snapshots++;
+  if (!progress_snapshot_path) {
+    log_dbg("=========== Statistics Snapshot ===========");
+    stats_write_json(stderr);
+    fflush(stderr);
+    return;
+  }
+
+  FILE* file = fopen(progress_snapshot_path, "w");
+  if (!file) {
+    log_dbg("Failed to open snapshot file %s", progress_snapshot_path);
+    return;
+  }
+  stats_write_json(file);
+  fclose(file);
+  log_dbg("Statistics snapshot written to %s", progress_snapshot_path);
+}
+
+static void report_progress(uint64_t instructions, uint64_t now_ns) {
+  long position = ftell(progress_trace);
+  uint64_t consumed = position > 0 ? (uint64_t)position : 0;
+  double elapsed_s = (now_ns - progress_start_ns) / 1e9;
+  double rate = elapsed_s > 0 ? instructions / elapsed_s : 0.0;
+
+  if (progress_trace_size > 0 && consumed > 0) {
+    double done = (double)consumed / progress_trace_size;
+    double eta_s = done > 0 ? elapsed_s * (1.0 - done) / done : 0.0;
+    log_dbg("[progress] %" PRIu64 " instructions, %" PRIu64 "/%" PRIu64
+            " B (%.1f%%), %.0f accesses/s, sim time %" PRIu64
+            " ns, ETA %.0f s",
+            instructions, consumed, progress_trace_size, 100.0 * done, rate,
+            get_time(), eta_s);
+  } else {
+    log_dbg("[progress] %" PRIu64 " instructions, %" PRIu64
+            " B, %.0f accesses/s, sim time %" PRIu64 " ns",
+            instructions, consumed, rate, get_time());
+  }
+}
+
+void progress_poll(uint64_t instructions) {
+  if (progress_snapshot_requested) {
+    progress_snapshot_requested = 0;
+    write_snapshot();
+  }
+
+  if (progress_interval_ns == 0 || (instructions & PROGRESS_POLL_MASK) != 0) {
+    return;
+  }
+
+  uint64_t now_ns = host_time_ns();
+  if (now_ns >= progress_next_report_ns) {
+    report_progress(instructions, now_ns);
+    progress_next_report_ns = now_ns + progress_interval_ns;
+  }
+}
+
+bool progress_interrupted() { return progress_stop_requested; }
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Live progress reporting and signal handling for long runs.
+//  - Every interval seconds (host time), prints instructions processed, trace
+//    bytes consumed, accesses per second and an ETA based on the trace size
+//    to stderr. An interval of 0 disables periodic reports.
+//  - SIGUSR1 dumps a snapshot of the statistics registry (see stats.h) as
+//    JSON to the snapshot file (stderr if none) without stopping the run.
+//  - SIGINT stops the run after the current instruction, so the final report
+//    and exports still get written for the partial run. A second SIGINT
+//    kills the simulator immediately.
+
+void progress_init(FILE* trace, uint64_t interval_seconds,
+                   const char* snapshot_path);
+
+// Called once per processed instruction from the main loop.
+void progress_poll(uint64_t instructions);
+
+bool progress_interrupted();
@@ -0,0 +1,175 @@
+#include "pwc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+
+typedef struct {
+  bool valid;
+  uint64_t tag;
+  uint64_t stamp;  // Last use (LRU) or insertion (FIFO).
+} pwc_entry_t;
+
+typedef struct {
+  pwc_entry_t* entries;
+  uint64_t size;
+  uint64_t hits;
+  uint64_t misses;
+} pwc_level_t;
+
+bool pwc_enabled = false;
+time_ns_t pwc_latency = 0;
+pwc_policy_t pwc_policy = PWC_LRU;
+uint64_t pwc_tick = 0;
+
+// Indexed by page table level; levels 0 and 1 (the PTEs) have no cache.
+pwc_level_t pwc_levels[PT_MAX_LEVELS + 1];
+
+static const char* pwc_policy_name(pwc_policy_t policy) {
+  switch (policy) {
+    case PWC_LRU:
+      return "lru";
+    case PWC_FIFO:
+      return "fifo";
+    case PWC_RANDOM:
+      return "random";
+  }
+  return "?";
+}
+
+static void pwc_register_level_stats(uint32_t level) {
+  static char names[PT_MAX_LEVELS + 1][2][32];
+  snprintf(names[level][0], sizeof(names[level][0]), "pwc.level%" PRIu32 ".hits",
+           level);
+  snprintf(names[level][1], sizeof(names[level][1]),
+           "pwc.level%" PRIu32 ".misses", level);
+  stats_register_counter(names[level][0], &pwc_levels[level].hits);
+  stats_register_counter(names[level][1], &pwc_levels[level].misses);
+}
+
+void pwc_enable(const uint64_t* entries, uint32_t levels, time_ns_t latency,
+                pwc_policy_t policy) {
+  if (page_table_levels() < 2) {
+    panic("--pwc: the flat page table has no upper levels to cache (see "
+          "--pt-levels)");
+  }
+  pwc_enabled = true;
+  pwc_latency = latency;
+  pwc_policy = policy;
+  for (uint32_t level = 2; level <= page_table_levels(); level++) {
+    // The last size given applies to the levels above it.
+    uint64_t size = entries[level - 2 < levels ? level - 2 : levels - 1];
+    if (size == 0) {
+      panic("--pwc: level %" PRIu32 " needs at least one entry", level);
+    }
+    pwc_levels[level].size = size;
+    pwc_levels[level].entries = calloc(size, sizeof(pwc_entry_t));
+    if (!pwc_levels[level].entries) {
+      panic("Out of memory allocating the page-walk caches");
+    }
+    pwc_register_level_stats(level);
+  }
+
+  stats_register_config("pwc.latency_ns", latency);
+  stats_register_config_string("pwc.policy", pwc_policy_name(policy));
+}
+
+bool pwc_is_enabled() { return pwc_enabled; }
+
+static uint64_t pwc_tag(va_t virtual_page_number, uint32_t level) {
+  return virtual_page_number >> (PT_LEVEL_BITS * (level - 1));
+}
+
+static pwc_entry_t* pwc_find(uint32_t level, uint64_t tag) {
+  pwc_level_t* cache = &pwc_levels[level];
+  for (uint64_t i = 0; i < cache->size; i++) {
+    if (cache->entries[i].valid && cache->entries[i].tag == tag) {
+      return &cache->entries[i];
+    }
+  }
+  return NULL;
+}
+
+uint32_t pwc_lookup(va_t virtual_page_number, uint32_t lowest_level) {
+  uint32_t levels = page_table_levels();
+  if (!pwc_enabled || lowest_level > levels) return levels;
+
+  // All levels are looked up in parallel.
+  increment_time(pwc_latency);
+  for (uint32_t level = lowest_level; level <= levels; level++) {
+    pwc_entry_t* entry = pwc_find(level, pwc_tag(virtual_page_number, level));
+    if (entry) {
+      pwc_levels[level].hits++;
+      if (pwc_policy == PWC_LRU) {
+        entry->stamp = ++pwc_tick;
+      }
+      return level - 1;
+    }
+    pwc_levels[level].misses++;
+  }
+  return levels;
+}
+
+void pwc_fill(va_t virtual_page_number, uint32_t level) {
+  if (!pwc_enabled) return;
+  uint64_t tag = pwc_tag(virtual_page_number, level);
+  if (pwc_find(level, tag)) return;
+
+  pwc_level_t* cache = &pwc_levels[level];
+  pwc_entry_t* victim = NULL;
+  for (uint64_t i = 0; i < cache->size && !victim; i++) {
+    if (!cache->entries[i].valid) {
+      victim = &cache->entries[i];
+    }
+  }
+  if (!victim && pwc_policy == PWC_RANDOM) {
+    victim = &cache->entries[(uint64_t)rand() % cache->size];
+  } else if (!victim) {
+    victim = &cache->entries[0];
+    for (uint64_t i = 1; i < cache->size; i++) {
+      if (cache->entries[i].stamp < victim->stamp) {
+        victim = &cache->entries[i];
+      }
+    }
+  }
+  *victim = (pwc_entry_t){true, tag, ++pwc_tick};
+}
+
+void pwc_flush() {
+  if (!pwc_enabled) return;
+  for (uint32_t level = 2; level <= page_table_levels(); level++) {
+    for (uint64_t i = 0; i < pwc_levels[level].size; i++) {
+      pwc_levels[level].entries[i].valid = false;
+    }
+  }
+}
+
+void pwc_report() {
+  if (page_table_levels() < 2) return;
+
+  uint64_t walks = get_total_page_walks();
+  log("=========== Page Walk Statistics ===========");
+  log("  %" PRIu32 "-level page table, %" PRIu64 " walks", page_table_levels(),
+      walks);
+  log("  Upper-level entry reads: %" PRIu64 " (%.2f per walk)",
+      get_total_upper_level_reads(),
+      walks ? (double)get_total_upper_level_reads() / walks : 0.0);
+  if (pwc_enabled) {
+    log("  Page-walk caches: %s, %" PRIu64 " ns", pwc_policy_name(pwc_policy),
+        pwc_latency);
+    log("  %-6s %8s %12s %12s %9s", "Level", "Entries", "Hits", "Misses",
+        "Hit rate");
+    for (uint32_t level = 2; level <= page_table_levels(); level++) {
+      const pwc_level_t* cache = &pwc_levels[level];
+      uint64_t lookups = cache->hits + cache->misses;
+      log("  %-6" PRIu32 " %8" PRIu64 " %12" PRIu64 " %12" PRIu64 " %8.2f%%",
+          level, cache->size, cache->hits, cache->misses,
+          lookups ? 100.0 * cache->hits / lookups : 0.0);
+    }
+  }
+  log("============================================");
+}
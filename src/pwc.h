@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Paging-structure (page-walk) caches of the MMU.
+// With a radix page table (page_table_set_levels), level 1 holds the PTEs
+// and each level above points to tables of the one below. There is one small
+// cache per upper level, holding entries of that level tagged by the page
+// number bits that index down to it (vpn >> PT_LEVEL_BITS * (level - 1)).
+// An L2 TLB miss looks them all up at once; the deepest hit tells the walk
+// which level to start reading at. Leaf entries (huge page PDEs) are not
+// cached. The caches are not tagged with an address space and are flushed
+// on every switch.
+
+typedef enum {
+  PWC_LRU,
+  PWC_FIFO,
+  PWC_RANDOM,
+} pwc_policy_t;
+
+// entries[i] is the size of the cache for level i + 2.
+void pwc_enable(const uint64_t* entries, uint32_t levels, time_ns_t latency,
+                pwc_policy_t policy);
+bool pwc_is_enabled();
+
+// First level a walk for the page has to read, among lowest_level and above
+// (it reads every level from there down to lowest_level). Charges the
+// lookup. Without caches, that's the root.
+uint32_t pwc_lookup(va_t virtual_page_number, uint32_t lowest_level);
+// The walk read the page's entry at an upper level.
+void pwc_fill(va_t virtual_page_number, uint32_t level);
+void pwc_flush();
+
+// Walk statistics (printed with more than one level) and per-level hit
+// rates.
+void pwc_report();
@@ -0,0 +1,350 @@
+#include "region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "stats.h"
+
+#define REGION_NAME_LENGTH 32
+
+typedef struct {
+  uint64_t accesses;
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t tlb_l1_hits;
+  uint64_t tlb_l2_hits;
+  uint64_t tlb_misses;
+  uint64_t faults;
+  uint64_t major_faults;
+  uint64_t evictions;
+  uint64_t latency_ns;
+} region_counters_t;
+
+typedef struct {
+  va_t start;  // Inclusive.
+  va_t end;    // Exclusive.
+  char name[REGION_NAME_LENGTH];
+  // Allocated apart, so they stay put for the statistics registry while
+  // regions move around in the array.
+  region_counters_t* counters;
+} region_t;
+
+bool region_enabled = false;
+bool region_auto = false;
+uint64_t region_auto_gap = 0;
+uint64_t region_auto_next_id = 0;
+
+// Sorted by start address, never overlapping.
+region_t* regions = NULL;
+uint64_t region_count = 0;
+uint64_t region_capacity = 0;
+
+// Accesses that fall outside every region loaded from a file. Exported as
+// "region.unmapped.*".
+region_counters_t region_unmapped_counters;
+region_t region_unmapped = {0, 0, "(unmapped)", &region_unmapped_counters};
+
+region_counters_t* region_current = NULL;
+uint64_t region_last_hit = 0;
+
+static void region_register_counter(const char* key, const char* field,
+                                    const uint64_t* counter) {
+  // Region names are only known at run time, so the registry gets its own
+  // copies of the counter names; they live until exit.
+  size_t length = strlen(key) + strlen(field) + 16;
+  char* name = malloc(length);
+  if (!name) {
+    panic("Out of memory registering region statistics");
+  }
+  snprintf(name, length, "region.%s.%s", key, field);
+  stats_register_counter(name, counter);
+}
+
+static void region_unregister_counter(const char* key, const char* field) {
+  char name[REGION_NAME_LENGTH + 32];
+  snprintf(name, sizeof(name), "region.%s.%s", key, field);
+  free((char*)stats_unregister(name));
+}
+
+// Registered as soon as a region exists, so that snapshots taken during the
+// run include it.
+static void region_register_stats(const char* key,
+                                  const region_counters_t* counters) {
+  region_register_counter(key, "accesses", &counters->accesses);
+  region_register_counter(key, "reads", &counters->reads);
+  region_register_counter(key, "writes", &counters->writes);
+  region_register_counter(key, "tlb_l1_hits", &counters->tlb_l1_hits);
+  region_register_counter(key, "tlb_l2_hits", &counters->tlb_l2_hits);
+  region_register_counter(key, "tlb_misses", &counters->tlb_misses);
+  region_register_counter(key, "faults", &counters->faults);
+  region_register_counter(key, "major_faults", &counters->major_faults);
+  region_register_counter(key, "evictions", &counters->evictions);
+  region_register_counter(key, "latency_ns", &counters->latency_ns);
+}
+
+static void region_unregister_stats(const char* key) {
+  region_unregister_counter(key, "accesses");
+  region_unregister_counter(key, "reads");
+  region_unregister_counter(key, "writes");
+  region_unregister_counter(key, "tlb_l1_hits");
+  region_unregister_counter(key, "tlb_l2_hits");
+  region_unregister_counter(key, "tlb_misses");
+  region_unregister_counter(key, "faults");
+  region_unregister_counter(key, "major_faults");
+  region_unregister_counter(key, "evictions");
+  region_unregister_counter(key, "latency_ns");
+}
+
+// Gives a freshly named region its counters.
+static void region_create_counters(region_t* region) {
+  region->counters = calloc(1, sizeof(region_counters_t));
+  if (!region->counters) {
+    panic("Out of memory allocating region statistics");
+  }
+  region_register_stats(region->name, region->counters);
+}
+
+static region_t* region_insert_at(uint64_t index) {
+  if (region_count == region_capacity) {
+    region_capacity = region_capacity ? region_capacity * 2 : 16;
+    regions = realloc(regions, region_capacity * sizeof(region_t));
+    if (!regions) {
+      panic("Out of memory allocating regions");
+    }
+  }
+  memmove(&regions[index + 1], &regions[index],
+          (region_count - index) * sizeof(region_t));
+  region_count++;
+  memset(&regions[index], 0, sizeof(region_t));
+  return &regions[index];
+}
+
+static void region_remove_at(uint64_t index) {
+  memmove(&regions[index], &regions[index + 1],
+          (region_count - index - 1) * sizeof(region_t));
+  region_count--;
+}
+
+// Index of the last region starting at or before address, or region_count if
+// there is none.
+static uint64_t region_predecessor(va_t address) {
+  uint64_t low = 0;
+  uint64_t high = region_count;
+  while (low < high) {
+    uint64_t mid = low + (high - low) / 2;
+    if (regions[mid].start <= address) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low == 0 ? region_count : low - 1;
+}
+
+static region_t* region_find(va_t address) {
+  // Consecutive accesses are very likely to hit the same region.
+  if (region_last_hit < region_count &&
+      address - regions[region_last_hit].start <
+          regions[region_last_hit].end - regions[region_last_hit].start) {
+    return &regions[region_last_hit];
+  }
+  uint64_t index = region_predecessor(address);
+  if (index < region_count && address < regions[index].end) {
+    region_last_hit = index;
+    return &regions[index];
+  }
+  return NULL;
+}
+
+static void region_counters_add(region_counters_t* to,
+                                const region_counters_t* from) {
+  to->accesses += from->accesses;
+  to->reads += from->reads;
+  to->writes += from->writes;
+  to->tlb_l1_hits += from->tlb_l1_hits;
+  to->tlb_l2_hits += from->tlb_l2_hits;
+  to->tlb_misses += from->tlb_misses;
+  to->faults += from->faults;
+  to->major_faults += from->major_faults;
+  to->evictions += from->evictions;
+  to->latency_ns += from->latency_ns;
+}
+
+// Auto mode: grows (or creates) the cluster the page of address belongs to.
+static region_t* region_infer(va_t address) {
+  va_t page_start = address & ~PAGE_OFFSET_MASK;
+  va_t page_end = page_start + PAGE_SIZE_BYTES;
+
+  uint64_t before = region_predecessor(address);
+  uint64_t after = before == region_count ? 0 : before + 1;
+
+  bool join_before =
+      before < region_count && page_start - regions[before].end < region_auto_gap;
+  bool join_after =
+      after < region_count && regions[after].start - page_end < region_auto_gap;
+
+  uint64_t index;
+  if (join_before && join_after) {
+    // The page bridges two clusters: merge them. The second one is gone, and
+    // so are its statistics.
+    regions[before].end = regions[after].end;
+    region_counters_add(regions[before].counters, regions[after].counters);
+    region_unregister_stats(regions[after].name);
+    free(regions[after].counters);
+    region_remove_at(after);
+    index = before;
+  } else if (join_before) {
+    regions[before].end = page_end;
+    index = before;
+  } else if (join_after) {
+    regions[after].start = page_start;
+    index = after;
+  } else {
+    index = after;
+    region_t* region = region_insert_at(index);
+    region->start = page_start;
+    region->end = page_end;
+    snprintf(region->name, sizeof(region->name), "auto%" PRIu64,
+             region_auto_next_id++);
+    region_create_counters(region);
+  }
+
+  region_last_hit = index;
+  return &regions[index];
+}
+
+void region_load(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    panic("Failed to open region file %s", path);
+  }
+
+  char line[256];
+  uint64_t line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_number++;
+    char* comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+
+    uint64_t start, end;
+    char name[REGION_NAME_LENGTH];
+    int fields = sscanf(line, "%" SCNx64 " %" SCNx64 " %31s", &start, &end,
+                        name);
+    if (fields <= 0) continue;
+    if (fields != 3 || end <= start) {
+      panic("Invalid region at %s:%" PRIu64 ": %s", path, line_number, line);
+    }
+
+    uint64_t index = region_predecessor(start);
+    index = index == region_count ? 0 : index + 1;
+    if ((index > 0 && regions[index - 1].end > start) ||
+        (index < region_count && regions[index].start < end)) {
+      panic("Region %s at %s:%" PRIu64 " overlaps another region", name, path,
+            line_number);
+    }
+    region_t* region = region_insert_at(index);
+    region->start = start;
+    region->end = end;
+    strcpy(region->name, name);
+    region_create_counters(region);
+  }
+  fclose(file);
+  region_register_stats("unmapped", region_unmapped.counters);
+
+  region_enabled = true;
+  log_dbg("Loaded %" PRIu64 " regions from %s", region_count, path);
+}
+
+void region_enable_auto(uint64_t gap_bytes) {
+  if (gap_bytes == 0) {
+    panic("--regions-auto: the gap must be at least 1 byte");
+  }
+  region_enabled = true;
+  region_auto = true;
+  region_auto_gap = gap_bytes;
+}
+
+bool region_is_enabled() { return region_enabled; }
+
+void region_access_begin(va_t virtual_address, op_t op) {
+  if (!region_enabled) return;
+  region_t* region = region_find(virtual_address);
+  if (!region) {
+    region = region_auto ? region_infer(virtual_address) : &region_unmapped;
+  }
+  region_current = region->counters;
+  region_current->accesses++;
+  if (op == OP_WRITE) {
+    region_current->writes++;
+  } else {
+    region_current->reads++;
+  }
+}
+
+void region_access_end(time_ns_t latency) {
+  if (!region_current) return;
+  region_current->latency_ns += latency;
+  region_current = NULL;
+}
+
+void region_record_tlb_l1_hit() {
+  if (region_current) region_current->tlb_l1_hits++;
+}
+
+void region_record_tlb_l2_hit() {
+  if (region_current) region_current->tlb_l2_hits++;
+}
+
+void region_record_tlb_miss() {
+  if (region_current) region_current->tlb_misses++;
+}
+
+void region_record_fault(bool major) {
+  if (!region_current) return;
+  region_current->faults++;
+  if (major) region_current->major_faults++;
+}
+
+void region_record_eviction(va_t virtual_page_number) {
+  if (!region_enabled) return;
+  region_t* region = region_find(virtual_page_number << PAGE_SIZE_BITS);
+  if (!region) region = &region_unmapped;
+  region->counters->evictions++;
+}
+
+static void region_print(region_t* region, uint64_t total_latency) {
+  const region_counters_t* c = region->counters;
+  uint64_t translations = c->tlb_l1_hits + c->tlb_l2_hits + c->tlb_misses;
+  log("  %-16s %-8" PRIx64 " %-8" PRIx64 " %10" PRIu64 " %8" PRIu64
+      " %7.2f%% %9" PRIu64 " %8" PRIu64 " %8" PRIu64 " %9" PRIu64
+      " %14" PRIu64 " %6.2f%%",
+      region->name, region->start, region->end, c->accesses, c->writes,
+      translations ? 100.0 * c->tlb_l1_hits / translations : 0.0,
+      c->tlb_misses, c->faults, c->major_faults, c->evictions, c->latency_ns,
+      total_latency ? 100.0 * c->latency_ns / total_latency : 0.0);
+}
+
+void region_report() {
+  if (!region_enabled) return;
+
+  uint64_t total_latency = region_unmapped.counters->latency_ns;
+  for (uint64_t i = 0; i < region_count; i++) {
+    total_latency += regions[i].counters->latency_ns;
+  }
+
+  log("=========== Region Statistics ===========");
+  log("  %-16s %-8s %-8s %10s %8s %8s %9s %8s %8s %9s %14s %7s", "Region",
+      "Start", "End", "Accesses", "Writes", "L1 hit", "TLB miss", "Faults",
+      "Major", "Evictions", "Latency ns", "Time");
+  for (uint64_t i = 0; i < region_count; i++) {
+    region_print(&regions[i], total_latency);
+  }
+  if (region_unmapped.counters->accesses > 0 ||
+      region_unmapped.counters->evictions > 0) {
+    region_print(&region_unmapped, total_latency);
+  }
+  log("=========================================");
+}
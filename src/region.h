@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Address-region tagged statistics.
+// The virtual address space is split into named regions (heap, stack, mmap'd
+// files, code, ...) and every counter of an access is attributed to the
+// region the access falls in. Regions come either from a file with one
+// "<start> <end> <name>" line per region (hex addresses, end exclusive, '#'
+// starts a comment), or are inferred while simulating by clustering touched
+// pages: pages less than gap bytes apart end up in the same region.
+
+void region_load(const char* path);
+void region_enable_auto(uint64_t gap_bytes);
+bool region_is_enabled();
+
+// Bracket one access; everything recorded in between is charged to the
+// access's region.
+void region_access_begin(va_t virtual_address, op_t op);
+void region_access_end(time_ns_t latency);
+
+void region_record_tlb_l1_hit();
+void region_record_tlb_l2_hit();
+void region_record_tlb_miss();
+void region_record_fault(bool major);
+// Evictions are charged to the region of the evicted page, not the accessor.
+void region_record_eviction(va_t virtual_page_number);
+
+void region_report();
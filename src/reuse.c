@@ -0,0 +1,242 @@
+#include "reuse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "vpn_map.h"
+
+#define REUSE_HISTOGRAM_BUCKETS 65
+#define REUSE_INITIAL_POSITIONS (1llu << 16)
+
+typedef struct {
+  // Position (in the Fenwick tree) of the most recent reference.
+  uint64_t last_position;
+  time_ns_t last_time;
+} reuse_page_t;
+
+bool reuse_enabled = false;
+const char* reuse_output_path = NULL;
+
+vpn_map_t reuse_index;
+reuse_page_t* reuse_pages = NULL;
+uint64_t reuse_page_count = 0;
+uint64_t reuse_page_capacity = 0;
+
+// Every reference gets the next position in a Fenwick (binary indexed) tree.
+// Only the most recent position of each page is marked, so the number of
+// marks between a page's previous position and now is exactly the number of
+// distinct pages touched in between: O(log n) per reference. When positions
+// run out the live marks are compacted to the front, which costs O(n) but
+// happens at most once every (capacity - distinct pages) references.
+uint32_t* reuse_tree = NULL;
+uint32_t* reuse_position_owner = NULL;
+uint64_t reuse_positions = 0;
+uint64_t reuse_next_position = 0;
+
+uint64_t reuse_distance_histogram[REUSE_HISTOGRAM_BUCKETS];
+uint64_t reuse_time_histogram[REUSE_HISTOGRAM_BUCKETS];
+uint64_t reuse_references = 0;
+uint64_t reuse_cold_references = 0;
+
+static void reuse_alloc_tree(uint64_t positions) {
+  free(reuse_tree);
+  free(reuse_position_owner);
+  reuse_positions = positions;
+  reuse_tree = calloc(positions + 1, sizeof(uint32_t));
+  reuse_position_owner = malloc(positions * sizeof(uint32_t));
+  if (!reuse_tree || !reuse_position_owner) {
+    panic("Out of memory allocating reuse distance tree");
+  }
+}
+
+static void tree_add(uint64_t position, int32_t delta) {
+  for (uint64_t i = position + 1; i <= reuse_positions; i += i & -i) {
+    reuse_tree[i] += delta;
+  }
+}
+
+// Number of marks in positions [0, position).
+static uint64_t tree_prefix(uint64_t position) {
+  uint64_t sum = 0;
+  for (uint64_t i = position; i > 0; i -= i & -i) {
+    sum += reuse_tree[i];
+  }
+  return sum;
+}
+
+static void reuse_compact() {
+  uint32_t* old_owner = reuse_position_owner;
+  uint64_t old_positions = reuse_next_position;
+  reuse_position_owner = NULL;
+
+  // Leave at least as much room for new references as there are live pages,
+  // so compactions stay amortized O(1) per reference.
+  uint64_t positions = reuse_positions;
+  while (positions < 2 * reuse_page_count) {
+    positions <<= 1;
+  }
+  reuse_alloc_tree(positions);
+
+  uint64_t next = 0;
+  for (uint64_t position = 0; position < old_positions; position++) {
+    reuse_page_t* page = &reuse_pages[old_owner[position]];
+    if (page->last_position != position) continue;
+    page->last_position = next;
+    reuse_position_owner[next] = old_owner[position];
+    next++;
+  }
+  free(old_owner);
+
+  // Every compacted position is marked, so the tree can be built in O(n).
+  for (uint64_t i = 1; i <= reuse_positions; i++) {
+    if (i <= next) reuse_tree[i] += 1;
+    uint64_t parent = i + (i & -i);
+    if (parent <= reuse_positions) {
+      reuse_tree[parent] += reuse_tree[i];
+    }
+  }
+  reuse_next_position = next;
+}
+
+static uint64_t histogram_bucket(uint64_t value) {
+  // Bucket 0 holds 0, bucket k holds [2^(k-1), 2^k).
+  return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+void reuse_enable(const char* output_path) {
+  reuse_enabled = true;
+  reuse_output_path = output_path;
+  reuse_reset();
+}
+
+bool reuse_is_enabled() { return reuse_enabled; }
+
+void reuse_reset() {
+  if (!reuse_enabled) {
+    return;
+  }
+  if (reuse_pages) {
+    vpn_map_free(&reuse_index);
+    free(reuse_pages);
+  }
+  vpn_map_init(&reuse_index, 1024);
+  reuse_page_capacity = 1024;
+  reuse_pages = malloc(reuse_page_capacity * sizeof(reuse_page_t));
+  if (!reuse_pages) {
+    panic("Out of memory allocating reuse distance pages");
+  }
+  reuse_page_count = 0;
+
+  reuse_alloc_tree(REUSE_INITIAL_POSITIONS);
+  reuse_next_position = 0;
+
+  memset(reuse_distance_histogram, 0, sizeof(reuse_distance_histogram));
+  memset(reuse_time_histogram, 0, sizeof(reuse_time_histogram));
+  reuse_references = 0;
+  reuse_cold_references = 0;
+}
+
+void reuse_record_access(va_t virtual_page_number, time_ns_t now) {
+  if (!reuse_enabled) return;
+
+  if (reuse_next_position == reuse_positions) {
+    reuse_compact();
+  }
+
+  reuse_references++;
+
+  bool inserted;
+  uint32_t index = *vpn_map_insert(&reuse_index, virtual_page_number,
+                                   (uint32_t)reuse_page_count, &inserted);
+  if (inserted) {
+    if (reuse_page_count == reuse_page_capacity) {
+      reuse_page_capacity <<= 1;
+      reuse_pages =
+          realloc(reuse_pages, reuse_page_capacity * sizeof(reuse_page_t));
+      if (!reuse_pages) {
+        panic("Out of memory allocating reuse distance pages");
+      }
+    }
+    reuse_page_count++;
+    reuse_cold_references++;
+  } else {
+    reuse_page_t* page = &reuse_pages[index];
+    uint64_t distance =
+        tree_prefix(reuse_next_position) - tree_prefix(page->last_position + 1);
+    reuse_distance_histogram[histogram_bucket(distance)]++;
+    reuse_time_histogram[histogram_bucket(now - page->last_time)]++;
+    tree_add(page->last_position, -1);
+  }
+
+  reuse_page_t* page = &reuse_pages[index];
+  page->last_position = reuse_next_position;
+  page->last_time = now;
+  reuse_position_owner[reuse_next_position] = index;
+  tree_add(reuse_next_position, 1);
+  reuse_next_position++;
+}
+
+static void write_histogram(FILE* file, const char* name,
+                            const uint64_t* histogram) {
+  for (uint64_t bucket = 0; bucket < REUSE_HISTOGRAM_BUCKETS; bucket++) {
+    if (histogram[bucket] == 0) continue;
+    uint64_t low = bucket == 0 ? 0 : 1llu << (bucket - 1);
+    uint64_t high = bucket == 0 ? 0 : (low << 1) - 1;
+    if (bucket == REUSE_HISTOGRAM_BUCKETS - 1) high = UINT64_MAX;
+    fprintf(file, "%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", name, low, high,
+            histogram[bucket]);
+  }
+}
+
+// Smallest bucket upper bound that covers at least the given fraction of the
+// (non-cold) references.
+static uint64_t histogram_percentile(const uint64_t* histogram,
+                                     double fraction) {
+  uint64_t warm = reuse_references - reuse_cold_references;
+  uint64_t target = (uint64_t)(fraction * warm);
+  uint64_t seen = 0;
+  for (uint64_t bucket = 0; bucket < REUSE_HISTOGRAM_BUCKETS; bucket++) {
+    seen += histogram[bucket];
+    if (seen > target) {
+      if (bucket >= 64) return UINT64_MAX;
+      return bucket == 0 ? 0 : (1llu << bucket) - 1;
+    }
+  }
+  return UINT64_MAX;
+}
+
+void reuse_report() {
+  if (!reuse_enabled) return;
+
+  log("=========== Reuse Analysis ===========");
+  log("References: %" PRIu64, reuse_references);
+  log("Cold references: %" PRIu64, reuse_cold_references);
+  if (reuse_references > reuse_cold_references) {
+    log("Reuse distance p50/p90/p99: <=%" PRIu64 " / <=%" PRIu64
+        " / <=%" PRIu64 " pages",
+        histogram_percentile(reuse_distance_histogram, 0.5),
+        histogram_percentile(reuse_distance_histogram, 0.9),
+        histogram_percentile(reuse_distance_histogram, 0.99));
+    log("Inter-reference time p50/p90/p99: <=%" PRIu64 " / <=%" PRIu64
+        " / <=%" PRIu64 " ns",
+        histogram_percentile(reuse_time_histogram, 0.5),
+        histogram_percentile(reuse_time_histogram, 0.9),
+        histogram_percentile(reuse_time_histogram, 0.99));
+  }
+
+  FILE* file = fopen(reuse_output_path, "w");
+  if (!file) {
+    panic("Failed to open reuse histogram file %s", reuse_output_path);
+  }
+  fprintf(file, "histogram,min,max,count\n");
+  fprintf(file, "cold,0,0,%" PRIu64 "\n", reuse_cold_references);
+  write_histogram(file, "reuse_distance_pages", reuse_distance_histogram);
+  write_histogram(file, "inter_reference_ns", reuse_time_histogram);
+  fclose(file);
+
+  log("Histograms written to %s", reuse_output_path);
+  log("======================================");
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Reuse-distance and inter-reference-time analysis.
+// For every reference to a page that was referenced before, records:
+//  - the reuse (stack) distance: number of distinct pages touched since the
+//    previous reference to the same page;
+//  - the inter-reference time: simulated ns since that previous reference.
+// Both go into log2-bucketed histograms written out as CSV at exit. First
+// references are counted separately as cold references (infinite distance).
+
+void reuse_enable(const char* output_path);
+bool reuse_is_enabled();
+void reuse_reset();
+
+void reuse_record_access(va_t virtual_page_number, time_ns_t now);
+
+void reuse_report();
@@ -0,0 +1,128 @@
+#include "segment.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+
+typedef struct {
+  asid_t asid;
+  va_t base;
+  va_t limit;
+  uint64_t offset;  // Physical minus virtual address (modulo 2^64).
+  uint64_t hits;
+} segment_t;
+
+segment_t segments[SEGMENT_MAX_ENTRIES];
+uint32_t segment_count = 0;
+
+uint64_t segment_lookups = 0;
+uint64_t segment_hits = 0;
+
+void segment_add(va_t base, va_t limit, pa_dram_t physical_base) {
+  uint64_t length = limit - base;
+  if (limit <= base || limit > VIRTUAL_SIZE_BYTES ||
+      ((base | limit | physical_base) & PAGE_OFFSET_MASK)) {
+    panic("Invalid segment [%" PRIx64 ", %" PRIx64 ") -> %" PRIx64
+          ": ranges must be non-empty, page aligned and inside the virtual "
+          "address space", base, limit, physical_base);
+  }
+  // Frame 0 holds the page table.
+  if (physical_base < PAGE_SIZE_BYTES || physical_base > DRAM_SIZE_BYTES ||
+      length > DRAM_SIZE_BYTES - physical_base) {
+    panic("Segment [%" PRIx64 ", %" PRIx64 ") doesn't fit in DRAM at %" PRIx64,
+          base, limit, physical_base);
+  }
+  if (segment_count == SEGMENT_MAX_ENTRIES) {
+    panic("At most %d segments are supported", SEGMENT_MAX_ENTRIES);
+  }
+  asid_t asid = page_table_current_asid();
+  for (uint32_t i = 0; i < segment_count; i++) {
+    if (segments[i].asid == asid && base < segments[i].limit &&
+        segments[i].base < limit) {
+      panic("Segment [%" PRIx64 ", %" PRIx64 ") overlaps another one", base,
+            limit);
+    }
+  }
+
+  page_table_unmap(base, length);
+  page_table_reserve_frames(physical_base >> PAGE_SIZE_BITS,
+                            length >> PAGE_SIZE_BITS);
+
+  if (segment_count == 0) {
+    stats_register_counter("segment.lookups", &segment_lookups);
+    stats_register_counter("segment.hits", &segment_hits);
+  }
+  segments[segment_count++] =
+      (segment_t){asid, base, limit, physical_base - base, 0};
+  log_dbg("***** Segment [%" PRIx64 ", %" PRIx64 ") -> %" PRIx64
+          " in address space %" PRIu32 " *****",
+          base, limit, physical_base, asid);
+}
+
+void segment_load(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    panic("Failed to open segment file %s", path);
+  }
+
+  char line[256];
+  uint64_t line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_number++;
+    char* comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+
+    uint64_t base, limit, physical_base;
+    int fields = sscanf(line, "%" SCNx64 " %" SCNx64 " %" SCNx64, &base,
+                        &limit, &physical_base);
+    if (fields <= 0) continue;
+    if (fields != 3) {
+      panic("Invalid segment at %s:%" PRIu64 ": %s", path, line_number, line);
+    }
+    segment_add(base, limit, physical_base);
+  }
+  fclose(file);
+}
+
+bool segment_translate(va_t virtual_address, pa_dram_t* physical_address) {
+  segment_lookups++;
+  if (segment_count == 0) return false;
+
+  asid_t asid = page_table_current_asid();
+  for (uint32_t i = 0; i < segment_count; i++) {
+    segment_t* segment = &segments[i];
+    if (segment->asid == asid &&
+        virtual_address - segment->base < segment->limit - segment->base) {
+      segment->hits++;
+      segment_hits++;
+      *physical_address = virtual_address + segment->offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+void segment_report() {
+  if (segment_count == 0) return;
+
+  log("=========== Direct Segment Statistics ===========");
+  log("  Translations served by segments: %" PRIu64 " of %" PRIu64
+      " (%.2f%%)",
+      segment_hits, segment_lookups,
+      segment_lookups ? 100.0 * segment_hits / segment_lookups : 0.0);
+  log("  %-6s %-10s %-10s %-10s %12s", "ASID", "Base", "Limit", "Physical",
+      "Hits");
+  for (uint32_t i = 0; i < segment_count; i++) {
+    const segment_t* segment = &segments[i];
+    log("  %-6" PRIu32 " %-10" PRIx64 " %-10" PRIx64 " %-10" PRIx64
+        " %12" PRIu64,
+        segment->asid, segment->base, segment->limit,
+        segment->base + segment->offset, segment->hits);
+  }
+  log("=================================================");
+}
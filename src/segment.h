@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Direct segments (range translation).
+// A segment maps the virtual range [base, limit) of one address space onto
+// the contiguous physical range starting at physical_base: every address in
+// it translates as va + offset, checked in parallel with the L1 TLB, so it
+// never misses in the TLB nor faults. The segment's frames are reserved for
+// good (their previous occupants are evicted) and whatever was paged in the
+// virtual range is unmapped, its contents not copied. Segments belong to the
+// address space current when they are added and are not inherited by fork;
+// they take precedence over later mappings of their range.
+
+// Adds a segment to the current address space. Ranges must be page aligned.
+void segment_add(va_t base, va_t limit, pa_dram_t physical_base);
+
+// Loads "<base> <limit> <physical base>" lines (hex, '#' comments) into the
+// current address space.
+void segment_load(const char* path);
+
+// Translates through the segments of the current address space, if one
+// covers the address. Counts every call, as one translation.
+bool segment_translate(va_t virtual_address, pa_dram_t* physical_address);
+
+void segment_report();
@@ -0,0 +1,182 @@
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+typedef enum {
+  STATS_COUNTER,
+  STATS_CONFIG,
+  STATS_CONFIG_STRING,
+} stats_kind_t;
+
+typedef struct {
+  const char* name;
+  stats_kind_t kind;
+  const uint64_t* counter;
+  uint64_t value;
+  const char* string;
+} stats_entry_t;
+
+stats_entry_t* stats_entries = NULL;
+uint64_t stats_count = 0;
+uint64_t stats_capacity = 0;
+
+static stats_entry_t* stats_entry(const char* name) {
+  for (uint64_t i = 0; i < stats_count; i++) {
+    if (strcmp(stats_entries[i].name, name) == 0) {
+      return &stats_entries[i];
+    }
+  }
+
+  if (stats_count == stats_capacity) {
+    stats_capacity = stats_capacity ? stats_capacity * 2 : 64;
+    stats_entries =
+        realloc(stats_entries, stats_capacity * sizeof(stats_entry_t));
+    if (!stats_entries) {
+      panic("Out of memory allocating the statistics registry");
+    }
+  }
+
+  stats_entry_t* entry = &stats_entries[stats_count++];
+  memset(entry, 0, sizeof(*entry));
+  entry->name = name;
+  return entry;
+}
+
+void stats_register_counter(const char* name, const uint64_t* counter) {
+  stats_entry_t* entry = stats_entry(name);
+  entry->kind = STATS_COUNTER;
+  entry->counter = counter;
+}
+
+void stats_register_config(const char* name, uint64_t value) {
+  stats_entry_t* entry = stats_entry(name);
+  entry->kind = STATS_CONFIG;
+  entry->value = value;
+}
+
+void stats_register_config_string(const char* name, const char* value) {
+  stats_entry_t* entry = stats_entry(name);
+  entry->kind = STATS_CONFIG_STRING;
+  entry->string = value ? value : "";
+}
+
+const char* stats_unregister(const char* name) {
+  for (uint64_t i = 0; i < stats_count; i++) {
+    if (strcmp(stats_entries[i].name, name) == 0) {
+      const char* registered = stats_entries[i].name;
+      memmove(&stats_entries[i], &stats_entries[i + 1],
+              (stats_count - i - 1) * sizeof(stats_entry_t));
+      stats_count--;
+      return registered;
+    }
+  }
+  return NULL;
+}
+
+static void write_json_string(FILE* file, const char* string) {
+  fputc('"', file);
+  for (const char* c = string; *c; c++) {
+    switch (*c) {
+      case '"':
+        fputs("\\\"", file);
+        break;
+      case '\\':
+        fputs("\\\\", file);
+        break;
+      case '\n':
+        fputs("\\n", file);
+        break;
+      default:
+        if ((unsigned char)*c < 0x20) {
+          fprintf(file, "\\u%04x", *c);
+        } else {
+          fputc(*c, file);
+        }
+    }
+  }
+  fputc('"', file);
+}
+
+static void write_csv_string(FILE* file, const char* string) {
+  fputc('"', file);
+  for (const char* c = string; *c; c++) {
+    if (*c == '"') fputc('"', file);
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+void stats_write_json(FILE* file) {
+  fprintf(file, "{\n  \"config\": {");
+  const char* separator = "\n";
+  for (uint64_t i = 0; i < stats_count; i++) {
+    const stats_entry_t* entry = &stats_entries[i];
+    if (entry->kind == STATS_COUNTER) continue;
+    fprintf(file, "%s    ", separator);
+    write_json_string(file, entry->name);
+    fprintf(file, ": ");
+    if (entry->kind == STATS_CONFIG) {
+      fprintf(file, "%" PRIu64, entry->value);
+    } else {
+      write_json_string(file, entry->string);
+    }
+    separator = ",\n";
+  }
+  fprintf(file, "\n  },\n  \"counters\": {");
+  separator = "\n";
+  for (uint64_t i = 0; i < stats_count; i++) {
+    const stats_entry_t* entry = &stats_entries[i];
+    if (entry->kind != STATS_COUNTER) continue;
+    fprintf(file, "%s    ", separator);
+    write_json_string(file, entry->name);
+    fprintf(file, ": %" PRIu64, *entry->counter);
+    separator = ",\n";
+  }
+  fprintf(file, "\n  }\n}\n");
+}
+
+void stats_write_csv(FILE* file) {
+  fprintf(file, "section,name,value\n");
+  for (uint64_t i = 0; i < stats_count; i++) {
+    const stats_entry_t* entry = &stats_entries[i];
+    switch (entry->kind) {
+      case STATS_CONFIG:
+        fprintf(file, "config,%s,%" PRIu64 "\n", entry->name, entry->value);
+        break;
+      case STATS_CONFIG_STRING:
+        fprintf(file, "config,%s,", entry->name);
+        write_csv_string(file, entry->string);
+        fputc('\n', file);
+        break;
+      case STATS_COUNTER:
+        break;
+    }
+  }
+  for (uint64_t i = 0; i < stats_count; i++) {
+    const stats_entry_t* entry = &stats_entries[i];
+    if (entry->kind != STATS_COUNTER) continue;
+    fprintf(file, "counter,%s,%" PRIu64 "\n", entry->name, *entry->counter);
+  }
+}
+
+void stats_export(const char* json_path, const char* csv_path) {
+  if (json_path) {
+    FILE* file = fopen(json_path, "w");
+    if (!file) {
+      panic("Failed to open statistics file %s", json_path);
+    }
+    stats_write_json(file);
+    fclose(file);
+  }
+  if (csv_path) {
+    FILE* file = fopen(csv_path, "w");
+    if (!file) {
+      panic("Failed to open statistics file %s", csv_path);
+    }
+    stats_write_csv(file);
+    fclose(file);
+  }
+}
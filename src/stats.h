@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Registry of named statistics, for machine-readable export.
+// Subsystems register pointers to their counters (and the configuration they
+// were built with) from their init functions; at exit the registry is dumped
+// as JSON or CSV. Names are dotted paths such as "tlb.l1.hits", and must be
+// string literals (the registry keeps the pointers). Registering a name twice
+// replaces the previous entry, so init functions can be called again.
+
+void stats_register_counter(const char* name, const uint64_t* counter);
+void stats_register_config(const char* name, uint64_t value);
+void stats_register_config_string(const char* name, const char* value);
+
+// Drops an entry, e.g. for something that stopped existing during the run.
+// Returns the name it was registered with (so that a caller who allocated it
+// can free it), or NULL if there was no such entry.
+const char* stats_unregister(const char* name);
+
+void stats_write_json(FILE* file);
+void stats_write_csv(FILE* file);
+
+// Writes the registry to the given paths; either may be NULL.
+void stats_export(const char* json_path, const char* csv_path);
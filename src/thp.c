@@ -0,0 +1,110 @@
+#include "thp.h"
+
+#include <stdlib.h>
+
+#include "clock.h"
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+#include "timeline.h"
+
+#define THP_REGIONS (TOTAL_PAGES / HUGE_PAGE_PAGES)
+
+bool thp_enabled = false;
+uint64_t thp_scan_period = 0;
+uint64_t thp_scan_regions = 0;
+
+uint64_t thp_accesses_until_scan = 0;
+uint64_t thp_scan_cursor = 0;  // Next region khugepaged looks at.
+
+uint64_t thp_scans = 0;
+uint64_t thp_scanned_regions = 0;
+uint64_t thp_collapses = 0;
+uint64_t thp_in_place_collapses = 0;
+uint64_t thp_collapse_failures = 0;
+time_ns_t thp_collapse_time = 0;
+uint64_t thp_splits[THP_SPLIT_CAUSES];
+
+void thp_enable(uint64_t scan_period, uint64_t scan_regions) {
+  if (scan_period == 0) {
+    panic("--thp: scan period must be at least 1 access");
+  }
+  if (scan_regions == 0 || scan_regions > THP_REGIONS) {
+    panic("--thp: between 1 and %" PRIu64 " regions per scan", THP_REGIONS);
+  }
+  thp_enabled = true;
+  thp_scan_period = scan_period;
+  thp_scan_regions = scan_regions;
+  thp_accesses_until_scan = scan_period;
+
+  stats_register_config("thp.huge_page_pages", HUGE_PAGE_PAGES);
+  stats_register_config("thp.scan_period", scan_period);
+  stats_register_config("thp.scan_regions", scan_regions);
+  stats_register_counter("thp.scans", &thp_scans);
+  stats_register_counter("thp.scanned_regions", &thp_scanned_regions);
+  stats_register_counter("thp.collapses", &thp_collapses);
+  stats_register_counter("thp.in_place_collapses", &thp_in_place_collapses);
+  stats_register_counter("thp.collapse_failures", &thp_collapse_failures);
+  stats_register_counter("thp.collapse_ns", &thp_collapse_time);
+  stats_register_counter("thp.unmap_splits", &thp_splits[THP_SPLIT_UNMAP]);
+  stats_register_counter("thp.eviction_splits",
+                         &thp_splits[THP_SPLIT_EVICTION]);
+  stats_register_counter("thp.cow_splits", &thp_splits[THP_SPLIT_COW]);
+}
+
+bool thp_is_enabled() { return thp_enabled; }
+
+static void khugepaged_scan() {
+  thp_scans++;
+  for (uint64_t i = 0; i < thp_scan_regions; i++) {
+    va_t first_virtual_page_number = thp_scan_cursor * HUGE_PAGE_PAGES;
+    thp_scan_cursor = (thp_scan_cursor + 1) % THP_REGIONS;
+    thp_scanned_regions++;
+
+    time_ns_t start = get_time();
+    switch (page_table_collapse(first_virtual_page_number)) {
+      case COLLAPSE_INELIGIBLE:
+        break;
+      case COLLAPSE_NO_FRAME:
+        thp_collapse_failures++;
+        break;
+      case COLLAPSE_IN_PLACE:
+        thp_in_place_collapses++;
+        // Fall through.
+      case COLLAPSE_COPIED:
+        thp_collapses++;
+        thp_collapse_time += get_time() - start;
+        timeline_complete("thp_collapse", start, "vpn",
+                          first_virtual_page_number);
+        break;
+    }
+  }
+}
+
+void thp_record_access() {
+  if (!thp_enabled || --thp_accesses_until_scan) return;
+  thp_accesses_until_scan = thp_scan_period;
+  khugepaged_scan();
+}
+
+void thp_record_split(thp_split_cause_t cause) { thp_splits[cause]++; }
+
+void thp_report() {
+  if (!thp_enabled) return;
+
+  log("====== Transparent Huge Page Statistics ======");
+  log("  khugepaged: %" PRIu64 " regions every %" PRIu64 " accesses",
+      thp_scan_regions, thp_scan_period);
+  log("  Regions scanned: %" PRIu64 " in %" PRIu64 " scans", thp_scanned_regions,
+      thp_scans);
+  log("  Collapses: %" PRIu64 " (%" PRIu64 " in place, %" PRIu64
+      " failed for lack of a free huge frame)",
+      thp_collapses, thp_in_place_collapses, thp_collapse_failures);
+  log("  Collapse time: %" PRIu64 " ns", thp_collapse_time);
+  log("  Splits: %" PRIu64 " unmap, %" PRIu64 " eviction, %" PRIu64
+      " copy-on-write",
+      thp_splits[THP_SPLIT_UNMAP], thp_splits[THP_SPLIT_EVICTION],
+      thp_splits[THP_SPLIT_COW]);
+  log("==============================================");
+}
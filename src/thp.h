@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Transparent huge pages (khugepaged model).
+// Every scan_period accesses, khugepaged looks at the next scan_regions
+// aligned regions of HUGE_PAGE_PAGES pages of the current address space.
+// A region whose pages are all resident, private and anonymous is collapsed:
+// its pages are copied into a free, aligned run of DRAM frames (in place if
+// they already are one) and its PTEs become a single huge mapping, cached by
+// one TLB entry. khugepaged shares the simulated clock with the trace, so
+// the copies are charged to it.
+//
+// A huge mapping is split back into ordinary pages (over the same frames)
+// whenever one of its pages has to change on its own.
+
+typedef enum {
+  THP_SPLIT_UNMAP,      // Unmap of part of the region.
+  THP_SPLIT_EVICTION,   // One of its pages is evicted under memory pressure.
+  THP_SPLIT_COW,        // Write to a huge mapping shared by fork.
+  THP_SPLIT_CAUSES,
+} thp_split_cause_t;
+
+void thp_enable(uint64_t scan_period, uint64_t scan_regions);
+bool thp_is_enabled();
+
+// Called once per data access; runs khugepaged when it is due.
+void thp_record_access();
+void thp_record_split(thp_split_cause_t cause);
+
+void thp_report();
@@ -0,0 +1,173 @@
+#include "tier.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+#include "timeline.h"
+
+// Promotions may burst up to one millisecond's worth of bandwidth.
+#define TIER_PROMOTE_BURST_NS 1000000
+
+bool tier_enabled = false;
+uint64_t tier_pages = 0;
+time_ns_t tier_latency = 0;
+uint64_t tier_hot_threshold = 0;
+uint64_t tier_promote_rate = 0;
+
+// Access count of each tier frame since it was demoted, halved whenever the
+// spill clock passes it.
+uint32_t* tier_hotness = NULL;
+uint64_t tier_clock_hand = 0;
+
+// Promotion bandwidth, as a budget of simulated time.
+time_ns_t tier_promote_budget = 0;
+time_ns_t tier_promote_last = 0;
+
+uint64_t tier_reads = 0;
+uint64_t tier_writes = 0;
+uint64_t tier_data_accesses = 0;
+uint64_t tier_demotions = 0;
+uint64_t tier_promotions = 0;
+uint64_t tier_throttled_promotions = 0;
+uint64_t tier_spills = 0;
+
+void tier_enable(uint64_t capacity_pages, time_ns_t latency,
+                 uint64_t hot_threshold, uint64_t promote_rate) {
+  // A promotion pins one tier frame while the tier may have to spill
+  // another, hence at least two.
+  if (capacity_pages < 2 || capacity_pages > TIER_MAX_PAGES) {
+    panic("--tier: capacity must be between 2 and %llu pages",
+          TIER_MAX_PAGES);
+  }
+  if (latency < DRAM_LATENCY_NS) {
+    panic("--tier: the slow tier can't be faster than DRAM (%d ns)",
+          DRAM_LATENCY_NS);
+  }
+  if (hot_threshold == 0) {
+    panic("--tier-hot: threshold must be at least 1");
+  }
+
+  tier_enabled = true;
+  tier_pages = capacity_pages;
+  tier_latency = latency;
+  tier_hot_threshold = hot_threshold;
+  tier_promote_rate = promote_rate;
+  tier_hotness = calloc(capacity_pages, sizeof(uint32_t));
+  if (!tier_hotness) {
+    panic("Out of memory allocating the slow tier");
+  }
+  tier_promote_budget = TIER_PROMOTE_BURST_NS;
+  tier_promote_last = get_time();
+
+  stats_register_config("tier.capacity_pages", capacity_pages);
+  stats_register_config("tier.latency_ns", latency);
+  stats_register_config("tier.hot_threshold", hot_threshold);
+  stats_register_config("tier.promote_rate_pages_per_ms", promote_rate);
+  stats_register_counter("tier.reads", &tier_reads);
+  stats_register_counter("tier.writes", &tier_writes);
+  stats_register_counter("tier.data_accesses", &tier_data_accesses);
+  stats_register_counter("tier.demotions", &tier_demotions);
+  stats_register_counter("tier.promotions", &tier_promotions);
+  stats_register_counter("tier.throttled_promotions",
+                         &tier_throttled_promotions);
+  stats_register_counter("tier.spills", &tier_spills);
+}
+
+bool tier_is_enabled() { return tier_enabled; }
+
+uint64_t tier_capacity() { return tier_pages; }
+
+bool tier_contains(pa_dram_t address) {
+  return tier_enabled && address >= DRAM_SIZE_BYTES;
+}
+
+static uint64_t tier_slot(pa_dram_t address) {
+  return (address >> PAGE_SIZE_BITS) - DRAM_PAGE_CAPACITY;
+}
+
+void tier_access(op_t op) {
+  if (op == OP_WRITE) {
+    tier_writes++;
+  } else {
+    tier_reads++;
+  }
+  increment_time(tier_latency);
+}
+
+// Takes one promotion's worth of bandwidth, if there is any left.
+static bool tier_take_promote_budget() {
+  if (tier_promote_rate == 0) return true;
+
+  time_ns_t now = get_time();
+  tier_promote_budget += now - tier_promote_last;
+  tier_promote_last = now;
+  if (tier_promote_budget > TIER_PROMOTE_BURST_NS) {
+    tier_promote_budget = TIER_PROMOTE_BURST_NS;
+  }
+  time_ns_t cost = TIER_PROMOTE_BURST_NS / tier_promote_rate;
+  if (tier_promote_budget < cost) return false;
+  tier_promote_budget -= cost;
+  return true;
+}
+
+void tier_record_data_access(va_t virtual_page_number, pa_dram_t address) {
+  if (!tier_enabled || !tier_contains(address)) return;
+
+  tier_data_accesses++;
+  increment_time(tier_latency - DRAM_LATENCY_NS);
+  uint32_t* hotness = &tier_hotness[tier_slot(address)];
+  if (*hotness < UINT32_MAX) {
+    (*hotness)++;
+  }
+  if (*hotness < tier_hot_threshold) return;
+
+  if (!tier_take_promote_budget()) {
+    tier_throttled_promotions++;
+    return;
+  }
+  time_ns_t start = get_time();
+  if (page_table_promote(virtual_page_number)) {
+    tier_promotions++;
+    timeline_complete("tier_promotion", start, "vpn", virtual_page_number);
+  }
+}
+
+void tier_record_demotion(pa_dram_t frame) {
+  tier_demotions++;
+  tier_hotness[frame - DRAM_PAGE_CAPACITY] = 0;
+}
+
+pa_dram_t tier_choose_victim(pa_dram_t pinned_frame) {
+  // Only called when every tier frame is in use. Each pass halves hotness,
+  // so this ends within about 32 sweeps.
+  for (;;) {
+    uint64_t slot = tier_clock_hand;
+    tier_clock_hand = (tier_clock_hand + 1) % tier_pages;
+    if (DRAM_PAGE_CAPACITY + slot == pinned_frame) continue;
+    if (tier_hotness[slot] == 0) {
+      return DRAM_PAGE_CAPACITY + slot;
+    }
+    tier_hotness[slot] /= 2;
+  }
+}
+
+void tier_record_spill() { tier_spills++; }
+
+void tier_report() {
+  if (!tier_enabled) return;
+
+  log("========== Memory Tier Statistics ==========");
+  log("  Slow tier: %" PRIu64 " pages, %" PRIu64 " ns", tier_pages,
+      tier_latency);
+  log("  Data accesses served from the tier: %" PRIu64, tier_data_accesses);
+  log("  Demotions: %" PRIu64, tier_demotions);
+  log("  Promotions: %" PRIu64 " (%" PRIu64 " throttled)", tier_promotions,
+      tier_throttled_promotions);
+  log("  Spills to disk: %" PRIu64, tier_spills);
+  log("  Tier reads/writes: %" PRIu64 "/%" PRIu64, tier_reads, tier_writes);
+  log("============================================");
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Slow memory tier between DRAM and disk (CXL memory expander, PMem).
+// Its frames are directly mapped like DRAM frames, just slower: they are
+// numbered after the DRAM frames, so their physical addresses start at
+// DRAM_SIZE_BYTES. Under memory pressure DRAM pages are demoted into the tier
+// instead of being swapped; only when the tier is full does its coldest page
+// (second-chance clock over decaying hotness counters) go to disk. Pages
+// accessed often enough while in the tier are promoted back to DRAM, at most
+// promote_rate pages per simulated millisecond (0 = unlimited).
+
+void tier_enable(uint64_t capacity_pages, time_ns_t latency,
+                 uint64_t hot_threshold, uint64_t promote_rate);
+bool tier_is_enabled();
+uint64_t tier_capacity();
+
+// Whether the physical address is in the slow tier.
+bool tier_contains(pa_dram_t address);
+
+// Page copies and write-backs that dram_access() routes to the tier.
+void tier_access(op_t op);
+// Translated data access: charged the tier's extra latency over DRAM (data
+// accesses to DRAM are free), and may trigger a promotion.
+void tier_record_data_access(va_t virtual_page_number, pa_dram_t address);
+
+// A page was just demoted into frame; resets its hotness.
+void tier_record_demotion(pa_dram_t frame);
+// Picks the tier frame to spill to disk when the tier is full, never
+// pinned_frame.
+pa_dram_t tier_choose_victim(pa_dram_t pinned_frame);
+void tier_record_spill();
+
+void tier_report();
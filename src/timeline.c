@@ -0,0 +1,134 @@
+#include "timeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+#define TIMELINE_BUFFER_BYTES (1 << 20)
+
+bool timeline_enabled = false;
+bool timeline_sampled = false;
+bool timeline_in_access = false;
+FILE* timeline_file = NULL;
+char* timeline_buffer = NULL;
+uint64_t timeline_sample_every = 1;
+time_ns_t timeline_start_ns = 0;
+time_ns_t timeline_end_ns = UINT64_MAX;
+uint64_t timeline_accesses = 0;
+uint64_t timeline_events = 0;
+
+void timeline_enable(const char* path, uint64_t sample_every,
+                     time_ns_t start_ns, time_ns_t end_ns) {
+  if (sample_every == 0) {
+    panic("--timeline-sample: sample period must be at least 1 access");
+  }
+  timeline_file = fopen(path, "w");
+  if (!timeline_file) {
+    panic("Failed to open timeline file %s", path);
+  }
+  timeline_buffer = malloc(TIMELINE_BUFFER_BYTES);
+  if (timeline_buffer) {
+    setvbuf(timeline_file, timeline_buffer, _IOFBF, TIMELINE_BUFFER_BYTES);
+  }
+
+  timeline_enabled = true;
+  timeline_sample_every = sample_every;
+  timeline_start_ns = start_ns;
+  timeline_end_ns = end_ns;
+  timeline_accesses = 0;
+  timeline_events = 0;
+
+  fprintf(timeline_file,
+          "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+          "\"args\":{\"name\":\"tlbsim\"}},\n"
+          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+          "\"args\":{\"name\":\"simulated CPU\"}}");
+}
+
+bool timeline_is_enabled() { return timeline_enabled; }
+
+void timeline_access_begin() {
+  if (!timeline_enabled) return;
+  timeline_in_access = true;
+  timeline_sampled = timeline_accesses % timeline_sample_every == 0;
+  timeline_accesses++;
+}
+
+// Inside an access, events follow its sampling decision. Events between
+// accesses (fork, unmap, populate, khugepaged...) are rare enough to always
+// be recorded.
+static inline bool timeline_recording() {
+  return timeline_enabled && (timeline_sampled || !timeline_in_access);
+}
+
+static inline bool timeline_in_range(time_ns_t start, time_ns_t end) {
+  return start <= timeline_end_ns && end >= timeline_start_ns;
+}
+
+// Trace-event timestamps are in microseconds; keep ns precision.
+static void print_us(time_ns_t ns) {
+  fprintf(timeline_file, "%" PRIu64 ".%03" PRIu64, ns / 1000, ns % 1000);
+}
+
+static void timeline_write(const char* name, char phase, time_ns_t start,
+                           time_ns_t end) {
+  fprintf(timeline_file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,"
+          "\"tid\":1,\"ts\":", name, phase);
+  print_us(start);
+  if (phase == 'X') {
+    fprintf(timeline_file, ",\"dur\":");
+    print_us(end - start);
+  } else {
+    fprintf(timeline_file, ",\"s\":\"t\"");
+  }
+  timeline_events++;
+}
+
+void timeline_access_end(const char* name, time_ns_t start,
+                         uint64_t virtual_address, uint64_t physical_address) {
+  bool sampled = timeline_sampled;
+  timeline_in_access = false;
+  timeline_sampled = false;
+  if (!sampled) return;
+  time_ns_t end = get_time();
+  if (!timeline_in_range(start, end)) return;
+  timeline_write(name, 'X', start, end);
+  fprintf(timeline_file,
+          ",\"args\":{\"va\":\"0x%" PRIx64 "\",\"pa\":\"0x%" PRIx64 "\"}}",
+          virtual_address, physical_address);
+}
+
+void timeline_complete(const char* name, time_ns_t start,
+                       const char* arg_name, uint64_t arg) {
+  if (!timeline_recording()) return;
+  time_ns_t end = get_time();
+  if (!timeline_in_range(start, end)) return;
+  timeline_write(name, 'X', start, end);
+  fprintf(timeline_file, ",\"args\":{\"%s\":\"0x%" PRIx64 "\"}}", arg_name,
+          arg);
+}
+
+void timeline_instant(const char* name, const char* arg_name, uint64_t arg) {
+  if (!timeline_recording()) return;
+  time_ns_t now = get_time();
+  if (!timeline_in_range(now, now)) return;
+  timeline_write(name, 'i', now, now);
+  fprintf(timeline_file, ",\"args\":{\"%s\":\"0x%" PRIx64 "\"}}", arg_name,
+          arg);
+}
+
+void timeline_close() {
+  if (!timeline_enabled) return;
+  fprintf(timeline_file, "\n]}\n");
+  fclose(timeline_file);
+  free(timeline_buffer);
+  timeline_file = NULL;
+  timeline_buffer = NULL;
+  timeline_enabled = false;
+  timeline_sampled = false;
+  timeline_in_access = false;
+  log_dbg("Timeline: %" PRIu64 " events from %" PRIu64 " accesses",
+          timeline_events, timeline_accesses);
+}
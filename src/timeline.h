@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+
+// Timeline export of simulated activity in the Chrome trace-event JSON format
+// (loadable in chrome://tracing and ui.perfetto.dev). Timestamps are on the
+// simulated clock.
+//
+// Each access is a complete ("X") event, with the TLB misses, page walks,
+// faults, evictions and disk I/O it caused nested inside it. To keep files
+// manageable only one access in every sample_every is recorded (together with
+// everything nested in it), and only events overlapping the simulated time
+// range [start_ns, end_ns] are written. Events outside any access (fork,
+// unmap, populate, khugepaged...) are always recorded.
+
+void timeline_enable(const char* path, uint64_t sample_every,
+                     time_ns_t start_ns, time_ns_t end_ns);
+bool timeline_is_enabled();
+
+// Brackets one access; decides whether it (and its nested events) is sampled.
+void timeline_access_begin();
+void timeline_access_end(const char* name, time_ns_t start,
+                         uint64_t virtual_address, uint64_t physical_address);
+
+// Records an event that started at start and ends now. Inside an access, does
+// nothing unless the access is being sampled.
+void timeline_complete(const char* name, time_ns_t start,
+                       const char* arg_name, uint64_t arg);
+void timeline_instant(const char* name, const char* arg_name, uint64_t arg);
+
+void timeline_close();
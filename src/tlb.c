@@ -4,16 +4,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "access_stream.h"
 #include "clock.h"
 #include "constants.h"
 #include "log.h"
 #include "memory.h"
+#include "page_stats.h"
 #include "page_table.h"
+#include "profile.h"
+#include "region.h"
+#include "segment.h"
+#include "stats.h"
+#include "timeline.h"
 
 typedef struct {
   bool valid;
   bool dirty;
+  // Cleared for pages shared copy-on-write: a write through the entry takes
+  // a protection fault to the page table.
+  bool writable;
   uint64_t last_access;
+  // A huge mapping is cached as one entry covering `pages` pages from its
+  // first one; ordinary entries cover a single page.
+  uint64_t pages;
   va_t virtual_page_number;
   pa_dram_t physical_page_number;
 } tlb_entry_t;
@@ -29,6 +42,46 @@ uint64_t tlb_l2_hits = 0;
 uint64_t tlb_l2_misses = 0;
 uint64_t tlb_l2_invalidations = 0;
 
+// Evictions of valid entries to make room for a new one. A dirty L1 eviction
+// is a spill into L2; a dirty L2 eviction is a write-back to the page table.
+uint64_t tlb_l1_clean_evictions = 0;
+uint64_t tlb_l1_dirty_evictions = 0;
+uint64_t tlb_l2_clean_evictions = 0;
+uint64_t tlb_l2_dirty_evictions = 0;
+
+// Dirty entries written back (L1 -> L2, L2 -> page table) on invalidation.
+uint64_t tlb_l1_invalidation_write_backs = 0;
+uint64_t tlb_l2_invalidation_write_backs = 0;
+
+uint64_t tlb_flushes = 0;
+uint64_t tlb_prefetches = 0;
+uint64_t tlb_prefetch_fills = 0;
+uint64_t tlb_prefetches_dropped = 0;
+uint64_t tlb_write_protect_faults = 0;
+uint64_t tlb_huge_hits = 0;
+
+// Hardware dirty bits: an entry's dirty flag only caches the PTE's, which the
+// first write through a clean entry sets in the page table right away.
+// Nothing is left to write back when the entry goes.
+// The updates are counted by the page table (page_table.dirty_bit_updates),
+// walks' included.
+bool tlb_hardware_dirty_bits = false;
+
+// Coalescing (CoLT): a walk fills one entry for the run of neighbouring pages
+// mapped to contiguous frames, within aligned groups of this many pages.
+uint64_t tlb_coalesce_pages = 1;
+uint64_t tlb_coalesced_fills = 0;
+uint64_t tlb_coalesced_fill_pages = 0;
+uint64_t tlb_coalesced_hits = 0;
+
+// Reach: pages covered by the valid entries of each level, and its sum over
+// all translations (for the average).
+uint64_t tlb_l1_reach = 0;
+uint64_t tlb_l2_reach = 0;
+uint64_t tlb_reach_samples = 0;
+uint64_t tlb_l1_reach_sum = 0;
+uint64_t tlb_l2_reach_sum = 0;
+
 uint64_t get_total_tlb_l1_hits() { return tlb_l1_hits; }
 uint64_t get_total_tlb_l1_misses() { return tlb_l1_misses; }
 uint64_t get_total_tlb_l1_invalidations() { return tlb_l1_invalidations; }
@@ -37,6 +90,22 @@ uint64_t get_total_tlb_l2_hits() { return tlb_l2_hits; }
 uint64_t get_total_tlb_l2_misses() { return tlb_l2_misses; }
 uint64_t get_total_tlb_l2_invalidations() { return tlb_l2_invalidations; }
 
+uint64_t get_total_tlb_l1_clean_evictions() { return tlb_l1_clean_evictions; }
+uint64_t get_total_tlb_l1_dirty_evictions() { return tlb_l1_dirty_evictions; }
+uint64_t get_total_tlb_l2_clean_evictions() { return tlb_l2_clean_evictions; }
+uint64_t get_total_tlb_l2_dirty_evictions() { return tlb_l2_dirty_evictions; }
+uint64_t get_total_tlb_l1_invalidation_write_backs() {
+  return tlb_l1_invalidation_write_backs;
+}
+uint64_t get_total_tlb_l2_invalidation_write_backs() {
+  return tlb_l2_invalidation_write_backs;
+}
+uint64_t get_total_tlb_write_protect_faults() {
+  return tlb_write_protect_faults;
+}
+uint64_t get_total_tlb_huge_hits() { return tlb_huge_hits; }
+uint64_t get_total_tlb_coalesced_hits() { return tlb_coalesced_hits; }
+
 //extracts the virtual page number (VPN) from a virtual address
 static inline va_t va_to_vpn(va_t va) {
   return (va_t)((uint64_t)va >> PAGE_SIZE_BITS);
@@ -57,11 +126,27 @@ static inline pa_dram_t compose_pa(uint64_t ppn, uint32_t off) {
   return (pa_dram_t)((ppn << PAGE_SIZE_BITS) | (uint64_t)off);
 }
 
+static inline bool entry_covers(const tlb_entry_t* entry, va_t vpn) {
+  return entry->valid && vpn - entry->virtual_page_number < entry->pages;
+}
+
+// Frame of a page through the entry covering it.
+static inline uint64_t entry_ppn(const tlb_entry_t* entry, va_t vpn) {
+  return (uint64_t)entry->physical_page_number +
+         (vpn - entry->virtual_page_number);
+}
+
+// Whether the entry holds dirty state the page table doesn't have yet.
+static inline bool needs_write_back(const tlb_entry_t* entry) {
+  return entry->valid && entry->dirty && !tlb_hardware_dirty_bits;
+}
+
 static uint64_t lru_tick = 0;
 static uint64_t lru_tick2 = 0;
 
 /* Forward declaration for internal helper used before its definition */
-static void l2_insert(va_t vpn, uint64_t ppn, bool dirty);
+static void l2_insert(va_t vpn, uint64_t ppn, uint64_t pages, bool dirty,
+                      bool writable);
 
 
 void tlb_init() {
@@ -73,14 +158,62 @@ void tlb_init() {
   tlb_l2_hits = 0;
   tlb_l2_misses = 0;
   tlb_l2_invalidations = 0;
+  tlb_l1_clean_evictions = 0;
+  tlb_l1_dirty_evictions = 0;
+  tlb_l2_clean_evictions = 0;
+  tlb_l2_dirty_evictions = 0;
+  tlb_l1_invalidation_write_backs = 0;
+  tlb_l2_invalidation_write_backs = 0;
+  tlb_flushes = 0;
+  tlb_prefetches = 0;
+  tlb_prefetch_fills = 0;
+  tlb_prefetches_dropped = 0;
+  tlb_write_protect_faults = 0;
+  tlb_huge_hits = 0;
+  tlb_coalesce_pages = 1;
+  tlb_coalesced_fills = 0;
+  tlb_coalesced_fill_pages = 0;
+  tlb_coalesced_hits = 0;
+  tlb_l1_reach = 0;
+  tlb_l2_reach = 0;
+  tlb_reach_samples = 0;
+  tlb_l1_reach_sum = 0;
+  tlb_l2_reach_sum = 0;
   lru_tick = 0;
   lru_tick2 = 0;
+
+  stats_register_config("tlb.l1.size", TLB_L1_SIZE);
+  stats_register_config("tlb.l1.latency_ns", TLB_L1_LATENCY_NS);
+  stats_register_config("tlb.l2.size", TLB_L2_SIZE);
+  stats_register_config("tlb.l2.latency_ns", TLB_L2_LATENCY_NS);
+  stats_register_counter("tlb.l1.hits", &tlb_l1_hits);
+  stats_register_counter("tlb.l1.misses", &tlb_l1_misses);
+  stats_register_counter("tlb.l1.invalidations", &tlb_l1_invalidations);
+  stats_register_counter("tlb.l2.hits", &tlb_l2_hits);
+  stats_register_counter("tlb.l2.misses", &tlb_l2_misses);
+  stats_register_counter("tlb.l2.invalidations", &tlb_l2_invalidations);
+  stats_register_counter("tlb.l1.clean_evictions", &tlb_l1_clean_evictions);
+  stats_register_counter("tlb.l1.dirty_evictions", &tlb_l1_dirty_evictions);
+  stats_register_counter("tlb.l2.clean_evictions", &tlb_l2_clean_evictions);
+  stats_register_counter("tlb.l2.dirty_evictions", &tlb_l2_dirty_evictions);
+  stats_register_counter("tlb.l1.invalidation_write_backs",
+                         &tlb_l1_invalidation_write_backs);
+  stats_register_counter("tlb.l2.invalidation_write_backs",
+                         &tlb_l2_invalidation_write_backs);
+  stats_register_counter("tlb.flushes", &tlb_flushes);
+  stats_register_counter("tlb.prefetches", &tlb_prefetches);
+  stats_register_counter("tlb.prefetch_fills", &tlb_prefetch_fills);
+  stats_register_counter("tlb.prefetches_dropped", &tlb_prefetches_dropped);
+  stats_register_counter("tlb.write_protect_faults",
+                         &tlb_write_protect_faults);
+  stats_register_counter("tlb.huge_hits", &tlb_huge_hits);
 }
 
 // Varre todas as entradas de L1: se válida e VPN igual, devolve o índice; senão -1 (miss)
 static int l1_find(va_t vpn) {
+  PROFILE_SCOPE(PROFILE_TLB_L1_FIND);
   for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
-    if (tlb_l1[i].valid && tlb_l1[i].virtual_page_number == vpn) {
+    if (entry_covers(&tlb_l1[i], vpn)) {
       return i;
     }
   }
@@ -89,8 +222,9 @@ static int l1_find(va_t vpn) {
 
 // Varre todas as entradas de L2: se válida e VPN igual, devolve o índice; senão -1 (miss)
 static int l2_find(va_t vpn) {
+  PROFILE_SCOPE(PROFILE_TLB_L2_FIND);
   for(int i = 0; i < (int)TLB_L2_SIZE; ++i) {
-    if (tlb_l2[i].valid && tlb_l2[i].virtual_page_number == vpn) {
+    if (entry_covers(&tlb_l2[i], vpn)) {
       return i;
     }
   }
@@ -102,6 +236,7 @@ static int l2_find(va_t vpn) {
 
 // L1 victim selection: escolher um slot inválido ou o menos usado recentemente
 static int l1_choose_victim(void) {
+  PROFILE_SCOPE(PROFILE_TLB_L1_VICTIM);
   for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
     if (!tlb_l1[i].valid) return i;
   }
@@ -118,6 +253,7 @@ static int l1_choose_victim(void) {
 
 //L2 victim selection: escolher um slot inválido ou o menos usado recentemente
 static int l2_choose_victim(void) {
+  PROFILE_SCOPE(PROFILE_TLB_L2_VICTIM);
   for (int i = 0; i < (int)TLB_L2_SIZE; ++i) {
     if (!tlb_l2[i].valid) return i;
   }
@@ -137,13 +273,20 @@ static int l2_choose_victim(void) {
 
 static void l1_evict_entry(int idx) {
   if (idx < 0) return;
-  if (tlb_l1[idx].valid && tlb_l1[idx].dirty) {
+  if (tlb_l1[idx].valid && !needs_write_back(&tlb_l1[idx])) {
+    ++tlb_l1_clean_evictions;
+  }
+  if (needs_write_back(&tlb_l1[idx])) {
+    ++tlb_l1_dirty_evictions;
     /* L1 write-back goes to L2, not directly to memory */
     va_t vpn = tlb_l1[idx].virtual_page_number;
     uint64_t ppn = (uint64_t)tlb_l1[idx].physical_page_number;
     
     /* Insert into L2 with dirty flag set */
-    l2_insert(vpn, ppn, true);
+    l2_insert(vpn, ppn, tlb_l1[idx].pages, true, true);
+  }
+  if (tlb_l1[idx].valid) {
+    tlb_l1_reach -= tlb_l1[idx].pages;
   }
   tlb_l1[idx].valid = false;
   tlb_l1[idx].dirty = false;
@@ -153,11 +296,18 @@ static void l1_evict_entry(int idx) {
 //Lógica do l1_evict_entry
 static void l2_evict_entry(int idx) {
   if (idx < 0) return;
-  if (tlb_l2[idx].valid && tlb_l2[idx].dirty) {
+  if (tlb_l2[idx].valid && !needs_write_back(&tlb_l2[idx])) {
+    ++tlb_l2_clean_evictions;
+  }
+  if (needs_write_back(&tlb_l2[idx])) {
+    ++tlb_l2_dirty_evictions;
     /* write-back must use the PHYSICAL frame address (PPN -> PA) */
     uint64_t ppn = (uint64_t)tlb_l2[idx].physical_page_number;
     pa_dram_t pa_for_writeback = compose_pa(ppn, 0);
-    write_back_tlb_entry(pa_for_writeback);
+    write_back_tlb_entry(tlb_l2[idx].virtual_page_number, pa_for_writeback);
+  }
+  if (tlb_l2[idx].valid) {
+    tlb_l2_reach -= tlb_l2[idx].pages;
   }
   tlb_l2[idx].valid = false;
   tlb_l2[idx].dirty = false;
@@ -166,42 +316,58 @@ static void l2_evict_entry(int idx) {
 
 // Inserir na L1. Atualiza no sítio se já existir na mesma página
 // Caso contrário escolhe uma vítima (write-back) e escreve a nova entrada
-static void l1_insert(va_t vpn, uint64_t ppn, bool dirty) {
+static void l1_insert(va_t vpn, uint64_t ppn, uint64_t pages, bool dirty,
+                      bool writable) {
   int idx = l1_find(vpn);
   if (idx >= 0) {
     //Já existe
-    /* Update in place */
+    /* Update in place (a coalesced entry may have grown to the left) */
+    tlb_l1_reach += pages - tlb_l1[idx].pages;
+    tlb_l1[idx].virtual_page_number = vpn;
     tlb_l1[idx].physical_page_number = (pa_dram_t)ppn; /* store only frame number */
     tlb_l1[idx].dirty = (tlb_l1[idx].dirty || dirty);
+    tlb_l1[idx].writable = writable;
     tlb_l1[idx].last_access = ++lru_tick;
+    tlb_l1[idx].pages = pages;
     tlb_l1[idx].valid = true;
     return;
   }
   //Nova entrada
   int victim = l1_choose_victim();
   l1_evict_entry(victim);
+  tlb_l1_reach += pages;
   tlb_l1[victim].valid = true;
   tlb_l1[victim].dirty = dirty;
+  tlb_l1[victim].writable = writable;
   tlb_l1[victim].last_access = ++lru_tick;
+  tlb_l1[victim].pages = pages;
   tlb_l1[victim].virtual_page_number = vpn;
   tlb_l1[victim].physical_page_number = (pa_dram_t)ppn; /* store only frame number */
 }
 
 // Inserir na L2. Lógica da L1
-static void l2_insert(va_t vpn, uint64_t ppn, bool dirty) {
+static void l2_insert(va_t vpn, uint64_t ppn, uint64_t pages, bool dirty,
+                      bool writable) {
   int idx = l2_find(vpn);
   if (idx >= 0) {
+    tlb_l2_reach += pages - tlb_l2[idx].pages;
+    tlb_l2[idx].virtual_page_number = vpn;
     tlb_l2[idx].physical_page_number = (pa_dram_t)ppn; 
     tlb_l2[idx].dirty = (tlb_l2[idx].dirty || dirty);
+    tlb_l2[idx].writable = writable;
     tlb_l2[idx].last_access = ++lru_tick2;
+    tlb_l2[idx].pages = pages;
     tlb_l2[idx].valid = true;
     return;
   }
   int victim = l2_choose_victim();
   l2_evict_entry(victim);
+  tlb_l2_reach += pages;
   tlb_l2[victim].valid = true;
   tlb_l2[victim].dirty = dirty;
+  tlb_l2[victim].writable = writable;
   tlb_l2[victim].last_access = ++lru_tick2;
+  tlb_l2[victim].pages = pages;
   tlb_l2[victim].virtual_page_number = vpn;
   tlb_l2[victim].physical_page_number = (pa_dram_t)ppn; 
 }
@@ -213,13 +379,15 @@ void tlb_invalidate(va_t virtual_page_number) {
   increment_time((time_ns_t)(TLB_L1_LATENCY_NS + TLB_L2_LATENCY_NS));
   /* L1 */
   for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
-    if (tlb_l1[i].valid && tlb_l1[i].virtual_page_number == virtual_page_number) {
-      if (tlb_l1[i].dirty) {
+    if (entry_covers(&tlb_l1[i], virtual_page_number)) {
+      if (needs_write_back(&tlb_l1[i])) {
+        ++tlb_l1_invalidation_write_backs;
         // L1 write-back to L2
         va_t vpn = tlb_l1[i].virtual_page_number;
         uint64_t ppn = (uint64_t)tlb_l1[i].physical_page_number;
-        l2_insert(vpn, ppn, true);
+        l2_insert(vpn, ppn, tlb_l1[i].pages, true, true);
       }
+      tlb_l1_reach -= tlb_l1[i].pages;
       tlb_l1[i].valid = false;
       tlb_l1[i].dirty = false;
       tlb_l1[i].last_access = 0;
@@ -230,13 +398,15 @@ void tlb_invalidate(va_t virtual_page_number) {
 
   /* L2 */
   for (int i = 0; i < (int)TLB_L2_SIZE; ++i) {
-    if (tlb_l2[i].valid && tlb_l2[i].virtual_page_number == virtual_page_number) {
-      if (tlb_l2[i].dirty) {
+    if (entry_covers(&tlb_l2[i], virtual_page_number)) {
+      if (needs_write_back(&tlb_l2[i])) {
+        ++tlb_l2_invalidation_write_backs;
         /* write-back must use the PHYSICAL frame address (PPN -> PA) */
         uint64_t ppn = (uint64_t)tlb_l2[i].physical_page_number;
         pa_dram_t pa_for_writeback = compose_pa(ppn, 0);
-        write_back_tlb_entry(pa_for_writeback);
+        write_back_tlb_entry(tlb_l2[i].virtual_page_number, pa_for_writeback);
       }
+      tlb_l2_reach -= tlb_l2[i].pages;
       tlb_l2[i].valid = false;
       tlb_l2[i].dirty = false;
       tlb_l2[i].last_access = 0;
@@ -246,8 +416,187 @@ void tlb_invalidate(va_t virtual_page_number) {
   }
 }
 
+void tlb_invalidate_range(va_t first_virtual_page_number, uint64_t pages) {
+  increment_time((time_ns_t)(TLB_L1_LATENCY_NS + TLB_L2_LATENCY_NS));
+  /* One pass over each level, whatever the size of the range. Dirty state is
+     discarded: the caller is tearing the mappings down. */
+  for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
+    if (tlb_l1[i].valid &&
+        tlb_l1[i].virtual_page_number < first_virtual_page_number + pages &&
+        first_virtual_page_number <
+            tlb_l1[i].virtual_page_number + tlb_l1[i].pages) {
+      tlb_l1_reach -= tlb_l1[i].pages;
+      tlb_l1[i].valid = false;
+      tlb_l1[i].dirty = false;
+      tlb_l1[i].last_access = 0;
+      ++tlb_l1_invalidations;
+    }
+  }
+  for (int i = 0; i < (int)TLB_L2_SIZE; ++i) {
+    if (tlb_l2[i].valid &&
+        tlb_l2[i].virtual_page_number < first_virtual_page_number + pages &&
+        first_virtual_page_number <
+            tlb_l2[i].virtual_page_number + tlb_l2[i].pages) {
+      tlb_l2_reach -= tlb_l2[i].pages;
+      tlb_l2[i].valid = false;
+      tlb_l2[i].dirty = false;
+      tlb_l2[i].last_access = 0;
+      ++tlb_l2_invalidations;
+    }
+  }
+}
+
+bool tlb_range_dirty(va_t first_virtual_page_number, uint64_t pages) {
+  for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
+    if (needs_write_back(&tlb_l1[i]) &&
+        tlb_l1[i].virtual_page_number < first_virtual_page_number + pages &&
+        first_virtual_page_number <
+            tlb_l1[i].virtual_page_number + tlb_l1[i].pages) {
+      return true;
+    }
+  }
+  for (int i = 0; i < (int)TLB_L2_SIZE; ++i) {
+    if (needs_write_back(&tlb_l2[i]) &&
+        tlb_l2[i].virtual_page_number < first_virtual_page_number + pages &&
+        first_virtual_page_number <
+            tlb_l2[i].virtual_page_number + tlb_l2[i].pages) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void tlb_flush() {
+  increment_time((time_ns_t)(TLB_L1_LATENCY_NS + TLB_L2_LATENCY_NS));
+  ++tlb_flushes;
+  /* Dirty L1 entries spill into L2 first, then dirty L2 entries are written
+     back, exactly as if each had been evicted. */
+  for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
+    l1_evict_entry(i);
+  }
+  for (int i = 0; i < (int)TLB_L2_SIZE; ++i) {
+    l2_evict_entry(i);
+  }
+}
+
+// Fills both levels with a translation the page table just gave. A huge
+// mapping gets a single entry for its whole region.
+static void fill_from_page_table(va_t vpn, uint64_t ppn, bool dirty,
+                                 bool writable) {
+  va_t first_vpn;
+  uint64_t pages = page_table_mapping_range(vpn, tlb_coalesce_pages,
+                                            &first_vpn);
+  uint64_t first_ppn = ppn - (vpn - first_vpn);
+  if (tlb_hardware_dirty_bits) {
+    dirty = page_table_dirty(vpn);
+  }
+  if (pages > 1 && pages < HUGE_PAGE_PAGES) {
+    ++tlb_coalesced_fills;
+    tlb_coalesced_fill_pages += pages;
+  }
+  l1_insert(first_vpn, first_ppn, pages, dirty, writable);
+  l2_insert(first_vpn, first_ppn, pages, dirty, writable);
+}
+
+void tlb_prefetch(va_t virtual_address) {
+  increment_time((time_ns_t)TLB_L1_LATENCY_NS);
+  ++tlb_prefetches;
+
+  pa_dram_t segment_address;
+  if (segment_translate(virtual_address, &segment_address)) {
+    return;
+  }
+  const va_t vpn = va_to_vpn(virtual_address);
+  if (l1_find(vpn) >= 0) {
+    return;
+  }
+
+  increment_time((time_ns_t)TLB_L2_LATENCY_NS);
+  int idx2 = l2_find(vpn);
+  if (idx2 >= 0) {
+    l1_insert(tlb_l2[idx2].virtual_page_number,
+              (uint64_t)tlb_l2[idx2].physical_page_number, tlb_l2[idx2].pages,
+              tlb_hardware_dirty_bits && tlb_l2[idx2].dirty,
+              tlb_l2[idx2].writable);
+    ++tlb_prefetch_fills;
+    return;
+  }
+
+  /* Like a hardware prefetch: walk the table, but never take a fault. */
+  pa_dram_t pa;
+  if (!page_table_lookup(virtual_address, &pa)) {
+    ++tlb_prefetches_dropped;
+    return;
+  }
+  fill_from_page_table(vpn, pa_to_ppn(pa), false, page_table_writable(vpn));
+  ++tlb_prefetch_fills;
+}
+
+// Drops the entries of at least min_pages pages covering a page, without
+// write-back and without time of their own (part of a fault or a dirty bit
+// update). Coalesced entries covering a page about to get a frame of its own
+// are read-only, hence clean.
+static void drop_entries(va_t vpn, uint64_t min_pages) {
+  for (int i = 0; i < (int)TLB_L1_SIZE; ++i) {
+    if (entry_covers(&tlb_l1[i], vpn) && tlb_l1[i].pages >= min_pages) {
+      tlb_l1_reach -= tlb_l1[i].pages;
+      tlb_l1[i].valid = false;
+      tlb_l1[i].dirty = false;
+    }
+  }
+  for (int i = 0; i < (int)TLB_L2_SIZE; ++i) {
+    if (entry_covers(&tlb_l2[i], vpn) && tlb_l2[i].pages >= min_pages) {
+      tlb_l2_reach -= tlb_l2[i].pages;
+      tlb_l2[i].valid = false;
+      tlb_l2[i].dirty = false;
+    }
+  }
+}
+
+// First write through a clean entry, with hardware dirty bits: the MMU sets
+// the PTE's dirty bit, then the translation is refilled dirty. The clean
+// entries are dropped first: a coalesced one's pages no longer share a dirty
+// bit, and the refill may start at another page.
+static void set_dirty_bit(va_t vpn, uint64_t ppn) {
+  page_table_set_dirty(vpn);
+  drop_entries(vpn, 1);
+  fill_from_page_table(vpn, ppn, true, true);
+}
+
+// Write through a read-only (copy-on-write) entry: the page table resolves
+// the COW fault, then the entry is refilled with the (possibly new) private
+// frame, writable and dirty.
+static pa_dram_t write_protect_fault(va_t virtual_address) {
+  ++tlb_write_protect_faults;
+  const va_t vpn = va_to_vpn(virtual_address);
+  drop_entries(vpn, 2);
+  pa_dram_t pa = page_table_translate(virtual_address, OP_WRITE);
+  fill_from_page_table(vpn, pa_to_ppn(pa), true, true);
+  return pa;
+}
+
+// Coalesced entries never span a whole huge page region, so those that do
+// are huge mappings.
+static inline void count_multi_page_hit(const tlb_entry_t* entry) {
+  if (entry->pages == HUGE_PAGE_PAGES) {
+    ++tlb_huge_hits;
+  } else if (entry->pages > 1) {
+    ++tlb_coalesced_hits;
+  }
+}
+
 pa_dram_t tlb_translate(va_t virtual_address, op_t op) {
   increment_time((time_ns_t)TLB_L1_LATENCY_NS);
+  ++tlb_reach_samples;
+  tlb_l1_reach_sum += tlb_l1_reach;
+  tlb_l2_reach_sum += tlb_l2_reach;
+
+  // Direct segments are looked up in parallel with L1 and bypass paging.
+  pa_dram_t segment_address;
+  if (segment_translate(virtual_address, &segment_address)) {
+    access_stream_set_level(ACCESS_HIT_SEGMENT);
+    return segment_address;
+  }
 
   // Divide VA em VPN e offset
   const va_t vpn = va_to_vpn(virtual_address);
@@ -258,17 +607,26 @@ pa_dram_t tlb_translate(va_t virtual_address, op_t op) {
   if (idx1 >= 0) {
     //Dá hit
     ++tlb_l1_hits;
+    region_record_tlb_l1_hit();
+    access_stream_set_level(ACCESS_HIT_TLB_L1);
     tlb_l1[idx1].last_access = ++lru_tick; // Atualiza lru
-    if (op == OP_WRITE) {
-      tlb_l1[idx1].dirty = true;
+    count_multi_page_hit(&tlb_l1[idx1]);
+    if (op == OP_WRITE && !tlb_l1[idx1].writable) {
+      return write_protect_fault(virtual_address);
     }
     // Guarda PPN (frame) na physical_page_number
-    uint64_t ppn = (uint64_t)tlb_l1[idx1].physical_page_number;
+    uint64_t ppn = entry_ppn(&tlb_l1[idx1], vpn);
+    if (op == OP_WRITE && tlb_hardware_dirty_bits && !tlb_l1[idx1].dirty) {
+      set_dirty_bit(vpn, ppn);
+    } else if (op == OP_WRITE) {
+      tlb_l1[idx1].dirty = true;
+    }
     return compose_pa(ppn, off);
   }
 
   // L1 MISS: Ir à page table (it will model DRAM/DISK latencies and print logs)
   ++tlb_l1_misses;
+  timeline_instant("tlb_l1_miss", "vpn", vpn);
   increment_time((time_ns_t)TLB_L2_LATENCY_NS);
 
   //Procurar na L2
@@ -276,24 +634,84 @@ pa_dram_t tlb_translate(va_t virtual_address, op_t op) {
   if (idx2 >= 0) {
     //há Hit
     ++tlb_l2_hits;
+    region_record_tlb_l2_hit();
+    access_stream_set_level(ACCESS_HIT_TLB_L2);
     tlb_l2[idx2].last_access = ++lru_tick2;
+    count_multi_page_hit(&tlb_l2[idx2]);
+    if (op == OP_WRITE && !tlb_l2[idx2].writable) {
+      return write_protect_fault(virtual_address);
+    }
+    if (op == OP_WRITE && tlb_hardware_dirty_bits && !tlb_l2[idx2].dirty) {
+      uint64_t ppn = entry_ppn(&tlb_l2[idx2], vpn);
+      set_dirty_bit(vpn, ppn);
+      return compose_pa(ppn, off);
+    }
     if (op == OP_WRITE) {
       tlb_l2[idx2].dirty = true;
     }
-    uint64_t ppn = (uint64_t)tlb_l2[idx2].physical_page_number;
     //Coloca também no L1
-    l1_insert(vpn, ppn, (op == OP_WRITE));
-    return compose_pa(ppn, off);
+    l1_insert(tlb_l2[idx2].virtual_page_number,
+              (uint64_t)tlb_l2[idx2].physical_page_number, tlb_l2[idx2].pages,
+              op == OP_WRITE ||
+                  (tlb_hardware_dirty_bits && tlb_l2[idx2].dirty),
+              tlb_l2[idx2].writable);
+    return compose_pa(entry_ppn(&tlb_l2[idx2], vpn), off);
   }
 
   //L2 miss
   ++tlb_l2_misses;
+  page_stats_record_tlb_miss(vpn);
+  region_record_tlb_miss();
+  access_stream_set_level(ACCESS_HIT_PAGE_TABLE);
+  timeline_instant("tlb_l2_miss", "vpn", vpn);
+  time_ns_t walk_start = get_time();
   pa_dram_t pa = page_table_translate(virtual_address, op);
+  timeline_complete("page_walk", walk_start, "vpn", vpn);
   uint64_t ppn = pa_to_ppn(pa);
 
   //Insere na L1 e L2 (write-back on victim if dirty)
-  l1_insert(vpn, ppn, (op == OP_WRITE));
-  l2_insert(vpn, ppn, (op == OP_WRITE));
+  fill_from_page_table(vpn, ppn, (op == OP_WRITE), page_table_writable(vpn));
 
   return pa; /* already includes ppn+offset; returning pa is fine */
 }
+
+void tlb_enable_coalescing(uint64_t pages) {
+  if (pages < 2 || pages >= HUGE_PAGE_PAGES || (pages & (pages - 1))) {
+    panic("--colt: group size must be a power of two between 2 and %" PRIu64,
+          HUGE_PAGE_PAGES / 2);
+  }
+  tlb_coalesce_pages = pages;
+
+  stats_register_config("tlb.coalesce_pages", pages);
+  stats_register_counter("tlb.coalesced_fills", &tlb_coalesced_fills);
+  stats_register_counter("tlb.coalesced_fill_pages",
+                         &tlb_coalesced_fill_pages);
+  stats_register_counter("tlb.coalesced_hits", &tlb_coalesced_hits);
+}
+
+void tlb_enable_hardware_dirty_bits() {
+  tlb_hardware_dirty_bits = true;
+  page_table_enable_hardware_dirty_bits();
+}
+
+void tlb_reach_report() {
+  uint64_t samples = tlb_reach_samples ? tlb_reach_samples : 1;
+  double l1_pages = (double)tlb_l1_reach_sum / samples;
+  double l2_pages = (double)tlb_l2_reach_sum / samples;
+
+  log("============ TLB Reach ============");
+  if (tlb_coalesce_pages > 1) {
+    log("  Coalescing: groups of %" PRIu64 " pages", tlb_coalesce_pages);
+    log("  Coalesced fills: %" PRIu64 " (%.2f pages each)", tlb_coalesced_fills,
+        tlb_coalesced_fills
+            ? (double)tlb_coalesced_fill_pages / tlb_coalesced_fills
+            : 0.0);
+    log("  Hits on coalesced entries: %" PRIu64, tlb_coalesced_hits);
+  }
+  log("  Hits on huge entries: %" PRIu64, tlb_huge_hits);
+  log("  Average reach: L1 %.1f pages (%.1f KiB), L2 %.1f pages (%.1f KiB)",
+      l1_pages, l1_pages * PAGE_SIZE_BYTES / 1024, l2_pages,
+      l2_pages * PAGE_SIZE_BYTES / 1024);
+  log("  Base-page reach: L1 %d pages, L2 %d pages", TLB_L1_SIZE, TLB_L2_SIZE);
+  log("===================================");
+}
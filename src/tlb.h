@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "memory.h"
@@ -14,6 +15,21 @@ pa_dram_t tlb_translate(va_t virtual_address, op_t op);
 // This can happen if a page is swapped out of memory and into the disk.
 void tlb_invalidate(va_t virtual_page_number);
 
+// Drops every entry overlapping [first, first + pages) without writing back
+// dirty state, in a single pass over each level (used when unmapping).
+void tlb_invalidate_range(va_t first_virtual_page_number, uint64_t pages);
+
+// Whether an entry overlapping [first, first + pages) holds dirty state not
+// yet written back to the page table. Pure query, no timing.
+bool tlb_range_dirty(va_t first_virtual_page_number, uint64_t pages);
+
+// Empties the TLB, writing back dirty entries (used on context switches).
+void tlb_flush();
+
+// Software prefetch: fills the TLB for the address if the page is resident,
+// without faulting and without counting as a hit or miss.
+void tlb_prefetch(va_t virtual_address);
+
 uint64_t get_total_tlb_l1_hits();
 uint64_t get_total_tlb_l1_misses();
 uint64_t get_total_tlb_l1_invalidations();
@@ -21,3 +37,37 @@ uint64_t get_total_tlb_l1_invalidations();
 uint64_t get_total_tlb_l2_hits();
 uint64_t get_total_tlb_l2_misses();
 uint64_t get_total_tlb_l2_invalidations();
+
+// Clean/dirty evictions of valid entries (dirty L1 evictions spill to L2,
+// dirty L2 evictions are written back to the page table).
+uint64_t get_total_tlb_l1_clean_evictions();
+uint64_t get_total_tlb_l1_dirty_evictions();
+uint64_t get_total_tlb_l2_clean_evictions();
+uint64_t get_total_tlb_l2_dirty_evictions();
+
+// Dirty entries written back when invalidated.
+uint64_t get_total_tlb_l1_invalidation_write_backs();
+uint64_t get_total_tlb_l2_invalidation_write_backs();
+
+// Writes that hit a read-only (copy-on-write) entry.
+uint64_t get_total_tlb_write_protect_faults();
+
+// Hits on entries caching a huge mapping (see thp.h).
+uint64_t get_total_tlb_huge_hits();
+
+// Coalesced entries (CoLT): one entry covers a run of neighbouring pages
+// mapped to contiguous frames within an aligned group of `pages` pages (a
+// power of two below HUGE_PAGE_PAGES).
+void tlb_enable_coalescing(uint64_t pages);
+uint64_t get_total_tlb_coalesced_hits();
+
+// Hardware-managed dirty bits, as on x86: the dirty flag of an entry only
+// caches the PTE's. The first write through a clean entry sets the dirty bit
+// in the page table at once (an atomic PTE write, see page_table_set_dirty)
+// and nothing is written back when dirty entries are evicted, invalidated or
+// flushed.
+void tlb_enable_hardware_dirty_bits();
+
+// Coalescing and huge page hits, and the average number of pages the TLB
+// covered over all translations.
+void tlb_reach_report();
@@ -0,0 +1,91 @@
+#include "vpn_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#define VPN_MAP_EMPTY_KEY UINT64_MAX
+
+// Fibonacci hashing: the multiply spreads page numbers over the high bits,
+// which are the ones kept. The low bits of the product only depend on the low
+// bits of the key, so power-of-two strides would pile up in a few slots.
+static inline uint64_t vpn_map_hash(uint64_t key, uint64_t capacity) {
+  return (key * 0x9e3779b97f4a7c15llu) >> (64 - __builtin_ctzll(capacity));
+}
+
+static vpn_map_slot_t* vpn_map_alloc_slots(uint64_t capacity) {
+  vpn_map_slot_t* slots = malloc(capacity * sizeof(vpn_map_slot_t));
+  if (!slots) {
+    panic("Out of memory allocating %" PRIu64 " page map slots", capacity);
+  }
+  memset(slots, 0xff, capacity * sizeof(vpn_map_slot_t));
+  return slots;
+}
+
+void vpn_map_init(vpn_map_t* map, uint64_t initial_capacity) {
+  uint64_t capacity = 16;
+  while (capacity < initial_capacity) {
+    capacity <<= 1;
+  }
+  map->slots = vpn_map_alloc_slots(capacity);
+  map->capacity = capacity;
+  map->size = 0;
+}
+
+void vpn_map_free(vpn_map_t* map) {
+  free(map->slots);
+  map->slots = NULL;
+  map->capacity = 0;
+  map->size = 0;
+}
+
+static vpn_map_slot_t* vpn_map_probe(vpn_map_slot_t* slots, uint64_t capacity,
+                                     uint64_t key) {
+  uint64_t mask = capacity - 1;
+  uint64_t i = vpn_map_hash(key, capacity);
+  while (slots[i].key != key && slots[i].key != VPN_MAP_EMPTY_KEY) {
+    i = (i + 1) & mask;
+  }
+  return &slots[i];
+}
+
+static void vpn_map_grow(vpn_map_t* map) {
+  uint64_t new_capacity = map->capacity << 1;
+  vpn_map_slot_t* new_slots = vpn_map_alloc_slots(new_capacity);
+  for (uint64_t i = 0; i < map->capacity; i++) {
+    if (map->slots[i].key != VPN_MAP_EMPTY_KEY) {
+      *vpn_map_probe(new_slots, new_capacity, map->slots[i].key) =
+          map->slots[i];
+    }
+  }
+  free(map->slots);
+  map->slots = new_slots;
+  map->capacity = new_capacity;
+}
+
+uint32_t* vpn_map_find(vpn_map_t* map, uint64_t key) {
+  vpn_map_slot_t* slot = vpn_map_probe(map->slots, map->capacity, key);
+  return slot->key == key ? &slot->value : NULL;
+}
+
+uint32_t* vpn_map_insert(vpn_map_t* map, uint64_t key, uint32_t new_value,
+                         bool* inserted) {
+  vpn_map_slot_t* slot = vpn_map_probe(map->slots, map->capacity, key);
+  if (slot->key == key) {
+    *inserted = false;
+    return &slot->value;
+  }
+
+  // Keep the load factor under 70% so probe sequences stay short.
+  if ((map->size + 1) * 10 > map->capacity * 7) {
+    vpn_map_grow(map);
+    slot = vpn_map_probe(map->slots, map->capacity, key);
+  }
+
+  slot->key = key;
+  slot->value = new_value;
+  map->size++;
+  *inserted = true;
+  return &slot->value;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sparse map from a page number (or any 64-bit page key) to a dense 32-bit
+// index. Analysis passes use it to keep their per-page records in a compact
+// array instead of a TOTAL_PAGES-sized table, so only touched pages cost
+// memory. Open addressing with linear probing; slots are 16 bytes so a probe
+// sequence usually stays within one or two cache lines.
+
+typedef struct {
+  uint64_t key;
+  uint32_t value;
+} vpn_map_slot_t;
+
+typedef struct {
+  vpn_map_slot_t* slots;
+  uint64_t capacity;  // Always a power of two.
+  uint64_t size;
+} vpn_map_t;
+
+void vpn_map_init(vpn_map_t* map, uint64_t initial_capacity);
+void vpn_map_free(vpn_map_t* map);
+
+// Returns the value stored for key, or NULL if the key is not present.
+uint32_t* vpn_map_find(vpn_map_t* map, uint64_t key);
+
+// Returns the value slot for key, inserting it (with value set to
+// new_value) if it is not present yet. *inserted tells which case happened.
+uint32_t* vpn_map_insert(vpn_map_t* map, uint64_t key, uint32_t new_value,
+                         bool* inserted);
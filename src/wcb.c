@@ -0,0 +1,112 @@
+#include "wcb.h"
+
+#include <stdlib.h>
+
+#include "constants.h"
+#include "log.h"
+#include "stats.h"
+
+typedef struct {
+  bool valid;
+  uint64_t line;
+  pa_dram_t address;
+  uint64_t last_write;
+} wcb_entry_t;
+
+bool wcb_enabled = false;
+wcb_entry_t* wcb_entries = NULL;
+uint64_t wcb_size = 0;
+uint64_t wcb_tick = 0;
+
+uint64_t wcb_writes = 0;
+uint64_t wcb_merges = 0;
+uint64_t wcb_capacity_flushes = 0;
+uint64_t wcb_access_flushes = 0;
+uint64_t wcb_drain_flushes = 0;
+
+void wcb_enable(uint64_t entries) {
+  if (entries == 0) {
+    panic("--wcb: the buffer needs at least one entry");
+  }
+  wcb_enabled = true;
+  wcb_size = entries;
+  wcb_entries = calloc(entries, sizeof(wcb_entry_t));
+  if (!wcb_entries) {
+    panic("Out of memory allocating the write-combining buffer");
+  }
+
+  stats_register_config("wcb.entries", entries);
+  stats_register_counter("wcb.writes", &wcb_writes);
+  stats_register_counter("wcb.merges", &wcb_merges);
+  stats_register_counter("wcb.capacity_flushes", &wcb_capacity_flushes);
+  stats_register_counter("wcb.access_flushes", &wcb_access_flushes);
+  stats_register_counter("wcb.drain_flushes", &wcb_drain_flushes);
+}
+
+bool wcb_is_enabled() { return wcb_enabled; }
+
+static void flush(wcb_entry_t* entry) {
+  dram_access(entry->address, OP_WRITE);
+  entry->valid = false;
+}
+
+void wcb_write(uint64_t line, pa_dram_t address) {
+  wcb_writes++;
+  wcb_entry_t* victim = &wcb_entries[0];
+  for (uint64_t i = 0; i < wcb_size; i++) {
+    wcb_entry_t* entry = &wcb_entries[i];
+    if (entry->valid && entry->line == line) {
+      wcb_merges++;
+      entry->last_write = ++wcb_tick;
+      return;
+    }
+    if (!entry->valid ||
+        (victim->valid && entry->last_write < victim->last_write)) {
+      victim = entry;
+    }
+  }
+  if (victim->valid) {
+    wcb_capacity_flushes++;
+    flush(victim);
+  }
+  *victim = (wcb_entry_t){true, line, address, ++wcb_tick};
+}
+
+void wcb_flush_line(uint64_t line) {
+  if (!wcb_enabled) return;
+  for (uint64_t i = 0; i < wcb_size; i++) {
+    if (wcb_entries[i].valid && wcb_entries[i].line == line) {
+      wcb_access_flushes++;
+      flush(&wcb_entries[i]);
+      return;
+    }
+  }
+}
+
+void wcb_drain() {
+  if (!wcb_enabled) return;
+  for (uint64_t i = 0; i < wcb_size; i++) {
+    if (wcb_entries[i].valid) {
+      wcb_drain_flushes++;
+      flush(&wcb_entries[i]);
+    }
+  }
+}
+
+void wcb_report() {
+  if (!wcb_enabled) return;
+
+  uint64_t flushes =
+      wcb_capacity_flushes + wcb_access_flushes + wcb_drain_flushes;
+  log("======== TLB Write-Back Buffer Statistics ========");
+  log("  %" PRIu64 " entries of %d-byte page table lines", wcb_size,
+      CACHE_LINE_SIZE_BYTES);
+  log("  Write-backs: %" PRIu64 ", %" PRIu64 " merged into a pending line",
+      wcb_writes, wcb_merges);
+  log("  DRAM writes: %" PRIu64 " (%" PRIu64 " saved, %.2f%%)", flushes,
+      wcb_merges, wcb_writes ? 100.0 * wcb_merges / wcb_writes : 0.0);
+  log("  Flushes: %" PRIu64 " for room, %" PRIu64
+      " before a PTE access, %" PRIu64 " at the end",
+      wcb_capacity_flushes, wcb_access_flushes, wcb_drain_flushes);
+  log("==================================================");
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+// Write-combining buffer for TLB write-backs.
+// Dirty TLB entries written back to the page table are held here, one entry
+// per page table cache line, instead of going to DRAM one by one: further
+// write-backs to a pending line merge into it for free. A line is written to
+// DRAM lazily, when the buffer needs its entry for another line (the least
+// recently written one goes), when the page table is about to read or rewrite
+// an entry in it (walks, faults, evictions, unmaps), or when the run ends.
+
+void wcb_enable(uint64_t entries);
+bool wcb_is_enabled();
+
+// Queues a write-back to the page table line, address being the DRAM address
+// the write goes to when the line is flushed.
+void wcb_write(uint64_t line, pa_dram_t address);
+// The page table reads or writes an entry in the line: any pending write to
+// it goes first.
+void wcb_flush_line(uint64_t line);
+// Writes every pending line out (end of the run).
+void wcb_drain();
+
+// Write-backs merged (DRAM writes saved) and why lines were flushed.
+void wcb_report();
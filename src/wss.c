@@ -0,0 +1,196 @@
+#include "wss.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+
+#define WSS_SKETCH_REGISTERS (1u << WSS_SKETCH_REGISTER_BITS)
+
+bool wss_enabled = false;
+wss_window_unit_t wss_unit = WSS_WINDOW_ACCESSES;
+uint64_t wss_window = 0;
+uint64_t wss_step = 0;
+const char* wss_output_path = NULL;
+FILE* wss_output = NULL;
+
+// wss_last_seen[register][rank - 1] holds (tick + 1) of the last access that
+// hashed to that register with that rank, or 0 if there was none.
+uint64_t (*wss_last_seen)[WSS_SKETCH_MAX_RANK] = NULL;
+
+uint64_t wss_accesses = 0;
+uint64_t wss_next_sample = 0;
+uint64_t wss_samples = 0;
+uint64_t wss_sum = 0;
+uint64_t wss_max = 0;
+uint64_t wss_max_tick = 0;
+
+static inline uint64_t wss_hash(uint64_t key) {
+  // splitmix64 finalizer: good avalanche, so the rank bits are uniform.
+  key += 0x9e3779b97f4a7c15llu;
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9llu;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111ebllu;
+  return key ^ (key >> 31);
+}
+
+// Natural logarithm for x >= 1, used by the small-range correction. Written
+// out to avoid pulling libm into the build for one call.
+static double natural_log(double x) {
+  const double ln2 = 0.69314718055994530942;
+  double result = 0.0;
+  while (x >= 2.0) {
+    x /= 2.0;
+    result += ln2;
+  }
+  // ln(x) = 2 * atanh((x - 1) / (x + 1)), converges quickly for x in [1, 2).
+  double y = (x - 1.0) / (x + 1.0);
+  double y2 = y * y;
+  double term = y;
+  double sum = 0.0;
+  for (int k = 1; k < 40; k += 2) {
+    sum += term / k;
+    term *= y2;
+  }
+  return result + 2.0 * sum;
+}
+
+static uint64_t wss_estimate(uint64_t now) {
+  double sum = 0.0;
+  uint64_t empty_registers = 0;
+  for (uint32_t reg = 0; reg < WSS_SKETCH_REGISTERS; reg++) {
+    int rank = WSS_SKETCH_MAX_RANK;
+    while (rank > 0) {
+      uint64_t seen = wss_last_seen[reg][rank - 1];
+      if (seen != 0 && seen + wss_window > now + 1) break;
+      rank--;
+    }
+    if (rank == 0) empty_registers++;
+    sum += 1.0 / (double)(1llu << rank);
+  }
+
+  const double m = WSS_SKETCH_REGISTERS;
+  const double alpha = 0.7213 / (1.0 + 1.079 / m);
+  double estimate = alpha * m * m / sum;
+  if (estimate <= 2.5 * m && empty_registers > 0) {
+    // Linear counting is more accurate for small cardinalities.
+    estimate = m * natural_log(m / (double)empty_registers);
+  }
+  return (uint64_t)(estimate + 0.5);
+}
+
+void wss_enable(wss_window_unit_t unit, uint64_t window, uint64_t step,
+                const char* output_path) {
+  if (window == 0) {
+    panic("WSS window must be greater than zero");
+  }
+  wss_enabled = true;
+  wss_unit = unit;
+  wss_window = window;
+  wss_step = step ? step : window;
+  wss_output_path = output_path;
+  wss_reset();
+}
+
+bool wss_is_enabled() { return wss_enabled; }
+
+void wss_reset() {
+  if (!wss_enabled) {
+    return;
+  }
+  if (!wss_last_seen) {
+    wss_last_seen = malloc(WSS_SKETCH_REGISTERS * sizeof(*wss_last_seen));
+    if (!wss_last_seen) {
+      panic("Out of memory allocating WSS sketch");
+    }
+  }
+  memset(wss_last_seen, 0, WSS_SKETCH_REGISTERS * sizeof(*wss_last_seen));
+
+  if (wss_output) {
+    fclose(wss_output);
+    wss_output = NULL;
+  }
+  if (wss_output_path) {
+    wss_output = fopen(wss_output_path, "w");
+    if (!wss_output) {
+      panic("Failed to open WSS output file %s", wss_output_path);
+    }
+    fprintf(wss_output, "sample,accesses,time_ns,wss_pages\n");
+  }
+
+  wss_accesses = 0;
+  wss_next_sample = wss_step;
+  wss_samples = 0;
+  wss_sum = 0;
+  wss_max = 0;
+  wss_max_tick = 0;
+}
+
+static void wss_sample(uint64_t tick, time_ns_t now) {
+  uint64_t estimate = wss_estimate(tick);
+  wss_samples++;
+  wss_sum += estimate;
+  if (estimate > wss_max) {
+    wss_max = estimate;
+    wss_max_tick = tick;
+  }
+  if (wss_output) {
+    fprintf(wss_output, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+            wss_samples, wss_accesses, now, estimate);
+  }
+}
+
+void wss_record_access(va_t virtual_page_number, time_ns_t now) {
+  if (!wss_enabled) return;
+
+  uint64_t tick = wss_unit == WSS_WINDOW_NS ? now : wss_accesses;
+  wss_accesses++;
+
+  uint64_t hash = wss_hash(virtual_page_number);
+  uint32_t reg = (uint32_t)(hash >> (64 - WSS_SKETCH_REGISTER_BITS));
+  uint64_t rest = hash << WSS_SKETCH_REGISTER_BITS;
+  int rank = rest ? __builtin_clzll(rest) + 1 : WSS_SKETCH_MAX_RANK;
+  if (rank > WSS_SKETCH_MAX_RANK) rank = WSS_SKETCH_MAX_RANK;
+  wss_last_seen[reg][rank - 1] = tick + 1;
+
+  if (tick + 1 >= wss_next_sample) {
+    wss_sample(tick, now);
+    // Time can jump by a whole disk access; don't emit a burst of identical
+    // samples for the intervals that had no accesses.
+    wss_next_sample = (tick + 1) - (tick + 1) % wss_step + wss_step;
+  }
+}
+
+void wss_report() {
+  if (!wss_enabled) return;
+
+  const char* unit = wss_unit == WSS_WINDOW_NS ? "ns" : "accesses";
+  uint64_t tlb_l1_reach = TLB_L1_SIZE;
+  uint64_t tlb_l2_reach = TLB_L2_SIZE;
+
+  log("=========== Working Set Size ===========");
+  log("Window: %" PRIu64 " %s, sampled every %" PRIu64 " %s", wss_window, unit,
+      wss_step, unit);
+  log("Samples: %" PRIu64, wss_samples);
+  if (wss_samples > 0) {
+    log("Mean WSS: %" PRIu64 " pages", wss_sum / wss_samples);
+    log("Max WSS: %" PRIu64 " pages (%" PRIu64 " KiB) at %s %" PRIu64, wss_max,
+        (wss_max * PAGE_SIZE_BYTES) >> 10, unit, wss_max_tick);
+    log("Max WSS vs DRAM capacity (%" PRIu64 " pages): %.2f%%",
+        DRAM_PAGE_CAPACITY, 100.0 * wss_max / DRAM_PAGE_CAPACITY);
+    log("Max WSS vs TLB L1 reach (%" PRIu64 " pages): %.2fx", tlb_l1_reach,
+        (double)wss_max / tlb_l1_reach);
+    log("Max WSS vs TLB L2 reach (%" PRIu64 " pages): %.2fx", tlb_l2_reach,
+        (double)wss_max / tlb_l2_reach);
+    if (wss_max > DRAM_PAGE_CAPACITY) {
+      log("Working set exceeds DRAM: expect page thrashing");
+    }
+  }
+  if (wss_output) {
+    fclose(wss_output);
+    wss_output = NULL;
+    log("Time series written to %s", wss_output_path);
+  }
+  log("========================================");
+}
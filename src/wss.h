@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Working-set-size (WSS) tracking.
+// Estimates the number of distinct pages touched in a sliding window, either
+// the last N accesses or the last T simulated ns, and samples it every step.
+// Distinct pages are counted with a sliding HyperLogLog sketch: each register
+// remembers, for every possible leading-zero count, when it was last seen, so
+// an estimate for any window ending now only needs one pass over the sketch.
+// Memory use is fixed (WSS_SKETCH_REGISTERS * WSS_SKETCH_MAX_RANK ticks) no
+// matter how many pages the trace touches.
+
+typedef enum { WSS_WINDOW_ACCESSES, WSS_WINDOW_NS } wss_window_unit_t;
+
+// step == 0 samples once per window. output_path may be NULL, in which case
+// only the summary is reported.
+void wss_enable(wss_window_unit_t unit, uint64_t window, uint64_t step,
+                const char* output_path);
+bool wss_is_enabled();
+void wss_reset();
+
+void wss_record_access(va_t virtual_page_number, time_ns_t now);
+
+void wss_report();
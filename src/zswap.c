@@ -0,0 +1,195 @@
+#include "zswap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "log.h"
+#include "page_table.h"
+#include "stats.h"
+#include "timeline.h"
+
+#define ZSWAP_NO_ENTRY UINT32_MAX
+
+typedef struct {
+  va_t virtual_page_number;
+  uint32_t size;        // Compressed size in bytes, 0 for a free entry.
+  uint32_t references;
+  // Store order, oldest first: the write-back order when the pool is full.
+  uint32_t older;
+  uint32_t newer;
+} zswap_entry_t;
+
+bool zswap_enabled = false;
+uint64_t zswap_pool_bytes_max = 0;
+time_ns_t zswap_decompress_latency = 0;
+uint64_t zswap_ratio_percent = ZSWAP_DEFAULT_RATIO_PERCENT;
+
+zswap_entry_t* zswap_entries = NULL;
+uint32_t zswap_entry_capacity = 0;
+uint32_t zswap_free_entry = ZSWAP_NO_ENTRY;  // Free list, through `newer`.
+uint32_t zswap_oldest = ZSWAP_NO_ENTRY;
+uint32_t zswap_newest = ZSWAP_NO_ENTRY;
+uint64_t zswap_pool_bytes = 0;
+
+uint64_t zswap_stores = 0;
+uint64_t zswap_rejects = 0;
+uint64_t zswap_loads = 0;
+uint64_t zswap_write_backs = 0;
+uint64_t zswap_stored_pages = 0;
+uint64_t zswap_peak_pool_bytes = 0;
+
+void zswap_enable(uint64_t pool_pages, time_ns_t decompress_latency) {
+  // The pool lives in DRAM and must leave room for everything else.
+  if (pool_pages == 0 || pool_pages > DRAM_PAGE_CAPACITY / 2) {
+    panic("--zswap: pool must be between 1 and %" PRIu64 " pages",
+          DRAM_PAGE_CAPACITY / 2);
+  }
+  zswap_enabled = true;
+  zswap_pool_bytes_max = pool_pages * PAGE_SIZE_BYTES;
+  zswap_decompress_latency = decompress_latency;
+
+  stats_register_config("zswap.pool_pages", pool_pages);
+  stats_register_config("zswap.decompress_latency_ns", decompress_latency);
+  stats_register_config("zswap.compress_latency_ns",
+                        ZSWAP_COMPRESS_LATENCY_NS);
+  stats_register_counter("zswap.stores", &zswap_stores);
+  stats_register_counter("zswap.rejects", &zswap_rejects);
+  stats_register_counter("zswap.loads", &zswap_loads);
+  stats_register_counter("zswap.write_backs", &zswap_write_backs);
+  stats_register_counter("zswap.stored_pages", &zswap_stored_pages);
+  stats_register_counter("zswap.pool_bytes", &zswap_pool_bytes);
+  stats_register_counter("zswap.peak_pool_bytes", &zswap_peak_pool_bytes);
+}
+
+bool zswap_is_enabled() { return zswap_enabled; }
+
+void zswap_set_ratio(uint64_t percent) {
+  if (percent == 0 || percent > 100) {
+    panic("Compression ratio must be between 1 and 100%%, not %" PRIu64,
+          percent);
+  }
+  zswap_ratio_percent = percent;
+}
+
+static void zswap_unlink(uint32_t index) {
+  zswap_entry_t* entry = &zswap_entries[index];
+  if (entry->older != ZSWAP_NO_ENTRY) {
+    zswap_entries[entry->older].newer = entry->newer;
+  } else {
+    zswap_oldest = entry->newer;
+  }
+  if (entry->newer != ZSWAP_NO_ENTRY) {
+    zswap_entries[entry->newer].older = entry->older;
+  } else {
+    zswap_newest = entry->older;
+  }
+}
+
+static void zswap_free(uint32_t index) {
+  zswap_unlink(index);
+  zswap_pool_bytes -= zswap_entries[index].size;
+  zswap_stored_pages--;
+  zswap_entries[index].size = 0;
+  zswap_entries[index].newer = zswap_free_entry;
+  zswap_free_entry = index;
+}
+
+static uint32_t zswap_allocate_entry() {
+  if (zswap_free_entry == ZSWAP_NO_ENTRY) {
+    uint32_t old_capacity = zswap_entry_capacity;
+    zswap_entry_capacity = old_capacity ? old_capacity * 2 : 1024;
+    zswap_entries =
+        realloc(zswap_entries, zswap_entry_capacity * sizeof(zswap_entry_t));
+    if (!zswap_entries) {
+      panic("Out of memory allocating zswap entries");
+    }
+    for (uint32_t i = zswap_entry_capacity; i-- > old_capacity;) {
+      zswap_entries[i].size = 0;
+      zswap_entries[i].newer = zswap_free_entry;
+      zswap_free_entry = i;
+    }
+  }
+  uint32_t index = zswap_free_entry;
+  zswap_free_entry = zswap_entries[index].newer;
+  return index;
+}
+
+// Writes the oldest entry back to disk (decompressing it first).
+static void zswap_write_back_oldest() {
+  uint32_t index = zswap_oldest;
+  time_ns_t start = get_time();
+  zswap_write_backs++;
+  increment_time(zswap_decompress_latency);
+  page_table_zswap_write_back(zswap_entries[index].virtual_page_number, index);
+  zswap_free(index);
+  timeline_complete("zswap_write_back", start, "entry", index);
+}
+
+bool zswap_store(va_t virtual_page_number, uint32_t references,
+                 uint32_t* entry) {
+  uint32_t size = PAGE_SIZE_BYTES * zswap_ratio_percent / 100;
+  if (zswap_ratio_percent > ZSWAP_MAX_RATIO_PERCENT) {
+    zswap_rejects++;
+    return false;
+  }
+
+  increment_time(ZSWAP_COMPRESS_LATENCY_NS);
+  while (zswap_pool_bytes + size > zswap_pool_bytes_max) {
+    zswap_write_back_oldest();
+  }
+
+  uint32_t index = zswap_allocate_entry();
+  zswap_entries[index] = (zswap_entry_t){virtual_page_number, size,
+                                         references, zswap_newest,
+                                         ZSWAP_NO_ENTRY};
+  if (zswap_newest != ZSWAP_NO_ENTRY) {
+    zswap_entries[zswap_newest].newer = index;
+  } else {
+    zswap_oldest = index;
+  }
+  zswap_newest = index;
+
+  zswap_pool_bytes += size;
+  if (zswap_pool_bytes > zswap_peak_pool_bytes) {
+    zswap_peak_pool_bytes = zswap_pool_bytes;
+  }
+  zswap_stores++;
+  zswap_stored_pages++;
+  *entry = index;
+  return true;
+}
+
+void zswap_load(uint32_t entry) {
+  zswap_loads++;
+  increment_time(zswap_decompress_latency);
+  zswap_release(entry);
+}
+
+void zswap_share(uint32_t entry) { zswap_entries[entry].references++; }
+
+void zswap_release(uint32_t entry) {
+  if (--zswap_entries[entry].references == 0) {
+    zswap_free(entry);
+  }
+}
+
+uint64_t zswap_pool_frames_needed() {
+  return (zswap_pool_bytes + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES;
+}
+
+void zswap_report() {
+  if (!zswap_enabled) return;
+
+  log("============ zswap Statistics ============");
+  log("  Pages stored: %" PRIu64 " (%" PRIu64 " rejected)", zswap_stores,
+      zswap_rejects);
+  log("  Swap-ins served from the pool: %" PRIu64, zswap_loads);
+  log("  Written back to disk: %" PRIu64, zswap_write_backs);
+  log("  Pool: %" PRIu64 " pages in %" PRIu64 " frames (peak %" PRIu64
+      " frames of %" PRIu64 ")",
+      zswap_stored_pages, zswap_pool_frames_needed(),
+      (zswap_peak_pool_bytes + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES,
+      zswap_pool_bytes_max / PAGE_SIZE_BYTES);
+  log("==========================================");
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "memory.h"
+
+// Compressed in-memory swap pool (zswap/zram).
+// Dirty anonymous pages evicted from DRAM are compressed into a pool instead
+// of being written to disk. The pool is made of ordinary DRAM frames, as many
+// as its compressed contents need, up to pool_pages; when full, its least
+// recently stored entries are written back to disk. Swap-ins served from the
+// pool cost a decompression instead of a disk read. The compression ratio is
+// a fixed percentage that the trace can change between phases ("Z <percent>"
+// records).
+//
+// Entries are reference counted: after a fork, parent and child share the
+// swapped page exactly as they would share a swap slot.
+
+void zswap_enable(uint64_t pool_pages, time_ns_t decompress_latency);
+bool zswap_is_enabled();
+void zswap_set_ratio(uint64_t percent);
+
+// Compresses an evicted page mapped by `references` address spaces at
+// virtual_page_number, making room if needed. Returns false if the page is
+// not worth compressing (it then goes to disk as usual).
+bool zswap_store(va_t virtual_page_number, uint32_t references,
+                 uint32_t* entry);
+// Swap-in: decompresses the entry and drops one reference to it.
+void zswap_load(uint32_t entry);
+void zswap_share(uint32_t entry);
+// Drops one reference without reading the entry (munmap).
+void zswap_release(uint32_t entry);
+
+// DRAM frames the pool's compressed contents occupy.
+uint64_t zswap_pool_frames_needed();
+
+void zswap_report();